@@ -40,6 +40,11 @@ void setup() {
   // after a 100 ms debounce (must be same as subscribe)
   Iono.linkDiDo(DI3, DO2, LINK_FLIP_H, 100);
 
+  // Let DI3 and DI4 wake up idle() through their interrupts.
+  // Leave out the pins the sketch attaches interrupts to
+  Iono.setWakeInterrupt(DI3, true);
+  Iono.setWakeInterrupt(DI4, true);
+
   // If DI5 and/or DI6 are used as TTL lines (jumper in BYP position)
   // call setBypass() and set their pin mode
   Iono.setBypass(DI5, INPUT);
@@ -92,10 +97,20 @@ void loop() {
     Serial.print("DI6 = ");
     Serial.println(Iono.read(DI6) == HIGH ? "high" : "low");
 
+    Serial.print("Sleep/awake ms = ");
+    Serial.print(Iono.getSleepTime());
+    Serial.print("/");
+    Serial.println(Iono.getAwakeTime());
+
     printTs = millis();
   }
 
-  delay(10);
+  // Sleep until the next Iono.process() is due: idle() wakes up
+  // earlier on digital input changes or when a debounce time
+  // expires. Analog inputs are not sampled while sleeping, so
+  // keep the sleep time smaller than their stable times
+  unsigned long elapsed = millis() - printTs;
+  Iono.idle(elapsed < 2000 ? min(2000 - elapsed, 100UL) : 0);
 }
 
 void onAV1change(uint8_t pin, float val) {
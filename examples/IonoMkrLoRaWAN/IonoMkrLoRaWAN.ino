@@ -16,7 +16,7 @@
 #include <Iono.h>
 #include "MKRWAN.h"
 #include "SerialConfig.h"
-#include "Watchdog.h"
+#include <IonoWatchdog.h>
 #include "CayenneLPP.h"
 
 #define DEBOUNCE_MS  25
@@ -39,6 +39,8 @@ unsigned long lastFullStateSendTs;
 unsigned long lastHeartbeatSendTs;
 bool needToSend = false;
 bool initialized = false;
+int ioTask;
+int loraTask;
 
 void setup() {
   pinMode(LED_BUILTIN, OUTPUT);
@@ -58,14 +60,21 @@ void setup() {
   lastUpdateSendTs = lastFullStateSendTs = lastHeartbeatSendTs = millis();
   digitalWrite(LED_BUILTIN, LOW);
 
-  // Sleep random time up to 7 seconds
+  // Sleep random time up to 7 seconds, the watchdog is already running
   uint32_t seed = 0;
   for (int i = 0; i < 32; i++) {
     seed <<= 1;
     seed |= analogRead(9) & 1;
   }
   randomSeed(seed);
-  delay(random(7000));
+  unsigned long sleepTime = random(7000);
+  unsigned long sleepTs = millis();
+  do {
+    IonoWatchdog.checkIn(ioTask);
+    IonoWatchdog.checkIn(loraTask);
+    IonoWatchdog.process();
+    delay(100);
+  } while (millis() - sleepTs < sleepTime);
 }
 
 void checkDataRate(bool force = false) {
@@ -117,6 +126,7 @@ void checkFrameCounters() {
 
 void loop() {
   Iono.process();
+  IonoWatchdog.checkIn(ioTask);
 
   unsigned long now = millis();
   if (now - lastFullStateSendTs >= 15 * 60000 || now - lastUpdateSendTs >= 7 * 60000) {
@@ -143,12 +153,13 @@ void loop() {
   checkDataRate();
 
   checkFrameCounters();
+  IonoWatchdog.checkIn(loraTask);
   
   if (SerialConfig.isAvailable) {
     SerialConfig.process();
   }
   
-  Watchdog.clear();
+  IonoWatchdog.process();
 }
 
 bool send(uint8_t* data, size_t len) {
@@ -269,7 +280,9 @@ void inputsCallback(uint8_t pin, float value) {
 }
 
 bool initialize() {
-  Watchdog.setup();
+  ioTask = IonoWatchdog.addTask("io", 7000);
+  loraTask = IonoWatchdog.addTask("lora", 7000);
+  IonoWatchdog.begin(8000);
   
   if (!modem.begin(SerialConfig.band)) {
     return false;
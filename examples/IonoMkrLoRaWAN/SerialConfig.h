@@ -18,7 +18,7 @@
 
 #include <FlashAsEEPROM.h>
 #include <FlashStorage.h>
-#include "Watchdog.h"
+#include <IonoWatchdog.h>
 
 #define CONSOLE_TIMEOUT 20000
 #define _PORT_USB SERIAL_PORT_MONITOR
@@ -155,7 +155,7 @@ void SerialConfig::_close() {
 }
 
 void SerialConfig::_enterConsole() {
-  Watchdog.disable();
+  IonoWatchdog.disable();
   delay(100);
   while(_port->read() >= 0) {
     delay(5);
@@ -14,7 +14,8 @@
 */
 
 #include <Iono.h>
-#include "Watchdog.h"
+#include <IonoWatchdog.h>
+#include <IonoRateLimiter.h>
 #include "SerialConfig.h"
 
 #include <ArduinoMqttClient.h>
@@ -26,9 +27,14 @@
 #define VALOUT 2
 #define VALAO1 3
 #define DISCONNECTED 6
+#define PUBLISH_CHANNEL_ITVL 1000
+#define PUBLISH_CHANNEL_BURST 3
+#define PUBLISH_ITVL 100
+#define PUBLISH_BURST 10
 
 WiFiClient wifiClient;
 MqttClient mqttClient(wifiClient);
+IonoRateLimiter publishLimiter;
 
 uint8_t in1;
 uint8_t in2;
@@ -54,6 +60,8 @@ bool retain;
 uint8_t qos;
 String topicAO1;
 bool watchdog;
+int ioTask;
+int netTask;
 
 void setup() {
   pinMode(LED_BUILTIN, OUTPUT);
@@ -70,6 +78,11 @@ void setup() {
 
   initialize();
 
+  if (IonoWatchdog.lastOverrun()[0] != '\0') {
+    Serial.print("Watchdog reset, task overrun: ");
+    Serial.println(IonoWatchdog.lastOverrun());
+  }
+
   lastUpdateSendTs = lastFullStateSendTs = millis();
   digitalWrite(LED_BUILTIN, LOW);
 
@@ -152,10 +165,7 @@ void subscribeToAll() {
 
 void loop() {
   Iono.process();
-
-  if (watchdog) {
-    Watchdog.clear();
-  }
+  IonoWatchdog.checkIn(ioTask);
 
   if (WiFi.status() != WL_CONNECTED) {
     connectToWifi();
@@ -173,6 +183,12 @@ void loop() {
       previousMillis = now;
     }
 
+    // throttled channels are sent with their latest value
+    float value;
+    while (publishLimiter.next(&value) >= 0) {
+      needToSend = true;
+    }
+
     // periodically resend all input statuses
     if (now - lastFullStateSendTs >= 15 * 60000 || now - lastUpdateSendTs >= 7 * 60000) {
       sendState(true);
@@ -181,10 +197,15 @@ void loop() {
       sendState(false);
     }
   }
+  IonoWatchdog.checkIn(netTask);
 
   if (SerialConfig.isAvailable) {
     SerialConfig.process();
   }
+
+  if (watchdog) {
+    IonoWatchdog.process();
+  }
 }
 
 void send(int opt, int val, int i) {
@@ -328,16 +349,26 @@ void inputsCallback(uint8_t pin, float value) {
     }
   }
 
-  needToSend = true;
+  // a chattering input must not flood the broker
+  if (publishLimiter.allow(pin, value)) {
+    needToSend = true;
+  }
 }
 
 void initialize() {
+  // WiFi and broker connections can legitimately block for several seconds,
+  // if any of them hangs the board is reset and the task name is kept
+  ioTask = IonoWatchdog.addTask("io", 15000);
+  netTask = IonoWatchdog.addTask("net", 15000);
   if (watchdog) {
-    Watchdog.setup();
+    IonoWatchdog.begin(16000);
   }
 
   Iono.setup();
 
+  publishLimiter.setChannelRate(PUBLISH_CHANNEL_ITVL, PUBLISH_CHANNEL_BURST);
+  publishLimiter.setTransportRate(PUBLISH_ITVL, PUBLISH_BURST);
+
   Iono.subscribeDigital(DO1, 0, &inputsCallback);
   Iono.subscribeDigital(DO2, 0, &inputsCallback);
   Iono.subscribeDigital(DO3, 0, &inputsCallback);
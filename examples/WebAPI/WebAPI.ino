@@ -20,12 +20,30 @@
 /
 / http://192.168.1.243/api/state
 /     returns a json object representing the
-/     current state of Iono's inputs and outputs
+/     current state of Iono's inputs and outputs.
+/     The answer carries an ETag, asking again
+/     with it in If-None-Match gets a 304 Not
+/     Modified if nothing has changed since
 /
 / http://192.168.1.243/api/set?DO1=1&DO2=1&AO1=5.30
 /     switches on relay DO1 and DO2 and sets a
 /     5.30V voltage on analog autput AO1
 /
+/ POST http://192.168.1.243/api/batch
+/     sets many outputs at once, either all
+/     of them or, if any is wrong, none.
+/     The body is a JSON object, e.g.:
+/     {"DO1":1,"DO2":"f","AO1":5.30,
+/      "DO3":{"value":1,"delay":2000,"pulse":500}}
+/     or a form with value, delay and pulse
+/     separated by commas, e.g.:
+/     DO1=1&DO2=f&AO1=5.30&DO3=1,2000,500
+/     DO3 is switched on after 2 seconds
+/     and back off 500 ms later. Returns
+/     e.g. {"outputs":4,"scheduled":2}, the
+/     number of delayed changes, at most 16
+/     waiting at a time (4 on AVR boards)
+/
 / http://192.168.1.243/api/subscribe?mv=0.1&st=100&host=192.168.1.242&port=8080&cmd=/bar&mode1=d&mode2=d&mode3=v&mode4=i
 /     Every time a pin changes value
 /     and is stable for 100ms (st=100)
@@ -42,6 +60,69 @@
 /     Input 2 will be read as digital (mode2=d),
 /     Input 3 will be read as voltage (mode3=v),
 /     Input 4 will be read as current (mode4=i).
+/     Changes occurring while a request is
+/     in progress are sent together in the
+/     next one, e.g. "/bar?DI1=0&AV3=5.10"
+/     The subscription lasts 60 seconds, call
+/     it again to renew it.
+/
+/ http://192.168.1.243/api/subscribe?host=192.168.1.250&cmd=/hist&ch=DO1,AV3&mv=0.5&lease=600
+/     Up to 4 subscribers (1 on AVR boards)
+/     are served at the same time, each with
+/     its own parameters. Here only DO1 and
+/     AV3 are sent (ch=DO1,AV3), for 600
+/     seconds (lease=600, at most 3600).
+/     Calling it again with the same host,
+/     port and cmd updates the subscription,
+/     lease=0 removes it.
+/     An input is read in the same mode for
+/     all: current if anyone asks for it,
+/     else voltage, else digital.
+/
+/ http://192.168.1.243/api/events?st=100&mv=0.1&mode3=v
+/     keeps the connection open and streams
+/     the changes as Server-Sent Events, first
+/     the whole state as a "state" event, then
+/     a message for each change, e.g.:
+/     data: {"DI1":1}
+/     st, mv, ch and mode parameters as for
+/     api/subscribe, all optional. They are
+/     shared by all the streams and WebSockets:
+/     while any is open, a request with
+/     different ones fails, without them it
+/     gets the same. Use it
+/     from a browser with
+/     new EventSource("/api/events")
+/
+/ http://192.168.1.243/api/history?ch=AV1&from=3600000&points=60
+/     returns the trend of AV1 over the last
+/     hour (from=3600000 ms ago) in at most
+/     60 points, e.g.:
+/     {"ch":"AV1","itvl":10000,"points":
+/      [[3590012,5.30,5.42],...]}
+/     each point is the age in ms, the min and
+/     the max of a group of samples. The
+/     analog inputs are sampled every 10
+/     seconds and the last hour is kept.
+/     Off by default, it takes about 7KB of
+/     RAM: build with IONO_WEB_HISTORY set
+/     to 1, see IonoWeb.h. Not on AVR boards
+/
+/ http://192.168.1.243/metrics
+/     loop and scan times, notifications,
+/     Modbus frames, HTTP requests, sockets
+/     and free memory in the Prometheus text
+/     format. Not on AVR boards, see
+/     IONO_METRICS in IonoMetrics.h
+/
+/ ws://192.168.1.243/api/ws
+/     WebSocket sending the same messages as
+/     api/events, plus the whole state every
+/     5 seconds. Send api/set parameters as a
+/     text message, e.g. "DO1=1&DO2=f", or
+/     "state" to get the whole state back.
+/     Not on AVR boards, see WEBDUINO_WEBSOCKET
+/     in WebServer.h
 */
 
 #include <SPI.h>
@@ -45,14 +45,23 @@ void setup() {
   / Input 2 will be read as digital (1),
   / Input 3 will be read as voltage (2),
   / Input 4 will be read as current (3).
+  / Changes occurring while a request is
+  / in progress are sent together in the
+  / next one, over the same connection if
+  / the server keeps it open.
   / Request examples:
   / http://192.168.1.242:8080/bar?DI1=1
   / http://192.168.1.242:8080/bar?AV3=5.30
+  / http://192.168.1.242:8080/bar?DI1=0&AV3=5.10
   */
   IonoWeb.subscribe(100, 0.1, "192.168.1.242", 8080, "/bar", 1, 1, 2, 3);
 }
 
 void loop() {
+  // Send the pending notifications without blocking.
+  // Without this call each change is sent, waiting
+  // for the connection, from Iono.process()
+  IonoWeb.processRequest();
   // Check all the inputs
   Iono.process();
 }
@@ -0,0 +1,2 @@
+// Host stand-in for the library tests, DNSClient is in Ethernet.h
+#include <Ethernet.h>
@@ -0,0 +1,47 @@
+// Host stand-in for the library tests, see stubs.cpp
+#ifndef Ethernet_h
+#define Ethernet_h
+
+#include <Arduino.h>
+#include <EthernetClient.h>
+#include <EthernetServer.h>
+
+class EthernetUDP : public Stream
+{
+  public:
+    uint8_t begin(uint16_t port);
+    uint8_t beginMulticast(IPAddress ip, uint16_t port);
+    void stop();
+    int beginPacket(IPAddress ip, uint16_t port);
+    int endPacket();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    int parsePacket();
+    int available();
+    int read();
+    int read(unsigned char *buffer, size_t size);
+    int read(char *buffer, size_t size) { return read((unsigned char *) buffer, size); }
+    int peek();
+    void flush();
+    IPAddress remoteIP();
+    uint16_t remotePort();
+};
+
+class EthernetClass
+{
+  public:
+    IPAddress localIP();
+    IPAddress dnsServerIP();
+    int maintain();
+};
+extern EthernetClass Ethernet;
+
+class DNSClient
+{
+  public:
+    void begin(const IPAddress &server);
+    int getHostByName(const char *host, IPAddress &ip);
+};
+
+#endif
@@ -0,0 +1,41 @@
+// Host stand-in for the library tests, see stubs.cpp
+#ifndef EthernetClient_h
+#define EthernetClient_h
+
+#include <Arduino.h>
+
+#define MAX_SOCK_NUM 8
+
+class EthernetClient : public Stream
+{
+  public:
+    EthernetClient();
+    EthernetClient(uint8_t sock);
+    uint8_t status();
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char *host, uint16_t port);
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    int availableForWrite();
+    int available();
+    int read();
+    int read(uint8_t *buffer, size_t size);
+    int peek();
+    void flush();
+    void stop();
+    uint8_t connected();
+    operator bool();
+    bool operator==(const EthernetClient &o) const { return _sock == o._sock; }
+    bool operator!=(const EthernetClient &o) const { return _sock != o._sock; }
+    uint8_t getSocketNumber() const { return _sock; }
+    uint16_t localPort();
+    IPAddress remoteIP();
+    uint16_t remotePort();
+    void setConnectionTimeout(uint16_t timeout);
+
+  private:
+    uint8_t _sock;
+};
+
+#endif
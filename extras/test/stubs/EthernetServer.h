@@ -0,0 +1,19 @@
+// Host stand-in for the library tests, see stubs.cpp
+#ifndef EthernetServer_h
+#define EthernetServer_h
+
+#include <EthernetClient.h>
+
+class EthernetServer : public Print
+{
+  public:
+    EthernetServer(uint16_t port);
+    void begin();
+    EthernetClient available();
+    EthernetClient accept();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+};
+
+#endif
@@ -0,0 +1 @@
+// Host stand-in for the library tests, nothing needed
@@ -0,0 +1,328 @@
+/*
+  stubs.cpp - Host stand-ins of the Arduino core and Ethernet library
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include "stubs.h"
+
+unsigned long stubMillis = 0;
+int stubDigital[64];
+int stubAnalog[64];
+uint8_t stubAttached[64];
+std::vector<StubDatagram> stubSent;
+std::vector<std::string> stubReceive;
+uint16_t stubRemotePort = 5000;
+StubSocket stubSockets[MAX_SOCK_NUM];
+
+static StubDatagram txDatagram;
+static std::string rxDatagram;
+static size_t rxPos = 0;
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+EthernetClass Ethernet;
+
+void stubReset() {
+  for (int i = 0; i < 64; i++) {
+    stubDigital[i] = 0;
+    stubAnalog[i] = 0;
+  }
+  stubSent.clear();
+  stubReceive.clear();
+  stubRemotePort = 5000;
+  for (int i = 0; i < MAX_SOCK_NUM; i++) {
+    stubSockets[i] = StubSocket();
+  }
+}
+
+int stubConnect(const std::string &request) {
+  for (int i = 0; i < MAX_SOCK_NUM; i++) {
+    if (!stubSockets[i].used) {
+      stubSockets[i] = StubSocket();
+      stubSockets[i].used = true;
+      stubSockets[i].open = true;
+      stubSockets[i].in = request;
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Arduino core
+
+extern "C" unsigned long millis() {
+  for (int i = 0; i < MAX_SOCK_NUM; i++) {
+    StubSocket *s = &stubSockets[i];
+    if (s->used && !s->late.empty()) {
+      s->in += s->late.substr(0, 64);
+      s->late.erase(0, 64);
+    }
+  }
+  return stubMillis;
+}
+extern "C" unsigned long micros() { return stubMillis * 1000; }
+void delay(unsigned long ms) { stubMillis += ms; }
+void delayMicroseconds(unsigned int us) {}
+int digitalRead(uint8_t pin) { return stubDigital[pin]; }
+void digitalWrite(uint8_t pin, uint8_t val) { stubDigital[pin] = val; }
+void pinMode(uint8_t pin, uint8_t mode) {}
+int analogRead(uint8_t pin) { return stubAnalog[pin]; }
+void analogWrite(uint8_t pin, int val) { stubAnalog[pin] = val; }
+void analogReadResolution(int bits) {}
+void analogWriteResolution(int bits) {}
+void attachInterrupt(uint8_t irq, void (*isr)(void), int mode) { stubAttached[irq] = 1; }
+void detachInterrupt(uint8_t irq) { stubAttached[irq] = 0; }
+void noInterrupts() {}
+void interrupts() {}
+void yield() {}
+long random(long max) { return 0; }
+long random(long min, long max) { return min; }
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size-- > 0) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::print(const char *str) { return write(str); }
+size_t Print::print(char c) { return write((uint8_t) c); }
+size_t Print::print(int n, int base) { return print((long) n, base); }
+size_t Print::print(unsigned int n, int base) { return print((unsigned long) n, base); }
+size_t Print::print(const __FlashStringHelper *str) { return write((const char *) str); }
+size_t Print::println(const char *str) { return print(str) + println(); }
+size_t Print::println() { return write("\r\n"); }
+
+size_t Print::print(long n, int base) {
+  char buff[24];
+  snprintf(buff, sizeof(buff), base == HEX ? "%lx" : "%ld", n);
+  return write(buff);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  char buff[24];
+  snprintf(buff, sizeof(buff), base == HEX ? "%lx" : "%lu", n);
+  return write(buff);
+}
+
+size_t Print::print(double n, int digits) {
+  char buff[32];
+  snprintf(buff, sizeof(buff), "%.*f", digits, n);
+  return write(buff);
+}
+
+void HardwareSerial::begin(unsigned long baud) {}
+void HardwareSerial::begin(unsigned long baud, uint16_t config) {}
+void HardwareSerial::end() {}
+size_t HardwareSerial::write(uint8_t c) { return 1; }
+int HardwareSerial::available() { return 0; }
+int HardwareSerial::read() { return -1; }
+int HardwareSerial::peek() { return -1; }
+
+bool IPAddress::fromString(const char *str) {
+  int a[4];
+  char c;
+  if (sscanf(str, "%d.%d.%d.%d%c", &a[0], &a[1], &a[2], &a[3], &c) != 4) {
+    return false;
+  }
+  for (int i = 0; i < 4; i++) {
+    _a[i] = a[i];
+  }
+  return true;
+}
+
+// UDP: every packet sent is recorded, the ones in stubReceive
+// are returned by parsePacket() in order, all from 10.0.0.2:5000
+
+uint8_t EthernetUDP::begin(uint16_t port) { return 1; }
+uint8_t EthernetUDP::beginMulticast(IPAddress ip, uint16_t port) { return 1; }
+void EthernetUDP::stop() {}
+
+int EthernetUDP::beginPacket(IPAddress ip, uint16_t port) {
+  char dest[24];
+  snprintf(dest, sizeof(dest), "%d.%d.%d.%d:%d", ip[0], ip[1], ip[2], ip[3], port);
+  txDatagram.dest = dest;
+  txDatagram.data.clear();
+  return 1;
+}
+
+int EthernetUDP::endPacket() {
+  stubSent.push_back(txDatagram);
+  return 1;
+}
+
+size_t EthernetUDP::write(uint8_t c) {
+  txDatagram.data += (char) c;
+  return 1;
+}
+
+size_t EthernetUDP::write(const uint8_t *buffer, size_t size) {
+  txDatagram.data.append((const char *) buffer, size);
+  return size;
+}
+
+int EthernetUDP::parsePacket() {
+  if (stubReceive.empty()) {
+    return 0;
+  }
+  rxDatagram = stubReceive.front();
+  stubReceive.erase(stubReceive.begin());
+  rxPos = 0;
+  return rxDatagram.size();
+}
+
+int EthernetUDP::available() { return rxDatagram.size() - rxPos; }
+int EthernetUDP::read() { return rxPos < rxDatagram.size() ? (uint8_t) rxDatagram[rxPos++] : -1; }
+
+int EthernetUDP::read(unsigned char *buffer, size_t size) {
+  size_t n = 0;
+  while (n < size && rxPos < rxDatagram.size()) {
+    buffer[n++] = rxDatagram[rxPos++];
+  }
+  return n;
+}
+
+int EthernetUDP::peek() { return rxPos < rxDatagram.size() ? (uint8_t) rxDatagram[rxPos] : -1; }
+void EthernetUDP::flush() {}
+IPAddress EthernetUDP::remoteIP() { return IPAddress(10, 0, 0, 2); }
+uint16_t EthernetUDP::remotePort() { return stubRemotePort; }
+
+// TCP: the server accepts the sockets opened by stubConnect(),
+// outbound connections get an empty reply
+
+EthernetClient::EthernetClient() : _sock(MAX_SOCK_NUM) {}
+EthernetClient::EthernetClient(uint8_t sock) : _sock(sock) {}
+
+uint8_t EthernetClient::status() {
+  return _sock < MAX_SOCK_NUM && stubSockets[_sock].used ? 0x17 : 0;
+}
+
+int EthernetClient::connect(IPAddress ip, uint16_t port) {
+  int sock = stubConnect("");
+  if (sock < 0) {
+    return 0;
+  }
+  _sock = sock;
+  stubSockets[sock].outbound = true;
+  return 1;
+}
+
+int EthernetClient::connect(const char *host, uint16_t port) {
+  return connect(IPAddress(), port);
+}
+
+size_t EthernetClient::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t EthernetClient::write(const uint8_t *buffer, size_t size) {
+  if (_sock >= MAX_SOCK_NUM) {
+    return 0;
+  }
+  stubSockets[_sock].out.append((const char *) buffer, size);
+  return size;
+}
+
+int EthernetClient::availableForWrite() { return 2048; }
+
+int EthernetClient::available() {
+  if (_sock >= MAX_SOCK_NUM) {
+    return 0;
+  }
+  return stubSockets[_sock].in.size() - stubSockets[_sock].pos;
+}
+
+int EthernetClient::read() {
+  if (available() == 0) {
+    return -1;
+  }
+  return (uint8_t) stubSockets[_sock].in[stubSockets[_sock].pos++];
+}
+
+int EthernetClient::read(uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (n < size && available() > 0) {
+    buffer[n++] = read();
+  }
+  return n > 0 ? (int) n : -1;
+}
+
+int EthernetClient::peek() {
+  if (available() == 0) {
+    return -1;
+  }
+  return (uint8_t) stubSockets[_sock].in[stubSockets[_sock].pos];
+}
+
+void EthernetClient::flush() {}
+
+void EthernetClient::stop() {
+  if (_sock < MAX_SOCK_NUM) {
+    stubSockets[_sock].used = false;
+    stubSockets[_sock].open = false;
+  }
+  _sock = MAX_SOCK_NUM;
+}
+
+uint8_t EthernetClient::connected() {
+  return _sock < MAX_SOCK_NUM && stubSockets[_sock].used && (stubSockets[_sock].open || available() > 0);
+}
+
+EthernetClient::operator bool() {
+  return _sock < MAX_SOCK_NUM && stubSockets[_sock].used;
+}
+
+uint16_t EthernetClient::localPort() { return 80; }
+IPAddress EthernetClient::remoteIP() { return IPAddress(10, 0, 0, 9); }
+uint16_t EthernetClient::remotePort() { return 40000 + _sock; }
+void EthernetClient::setConnectionTimeout(uint16_t timeout) {}
+
+EthernetServer::EthernetServer(uint16_t port) {}
+void EthernetServer::begin() {}
+
+EthernetClient EthernetServer::accept() {
+  for (int i = 0; i < MAX_SOCK_NUM; i++) {
+    StubSocket *s = &stubSockets[i];
+    if (s->used && !s->outbound && !s->accepted) {
+      s->accepted = true;
+      return EthernetClient(i);
+    }
+  }
+  return EthernetClient();
+}
+
+EthernetClient EthernetServer::available() {
+  for (int i = 0; i < MAX_SOCK_NUM; i++) {
+    StubSocket *s = &stubSockets[i];
+    if (s->used && !s->outbound && s->in.size() > s->pos) {
+      s->accepted = true;
+      return EthernetClient(i);
+    }
+  }
+  return EthernetClient();
+}
+
+size_t EthernetServer::write(uint8_t c) { return 1; }
+size_t EthernetServer::write(const uint8_t *buffer, size_t size) { return size; }
+
+IPAddress EthernetClass::localIP() { return IPAddress(10, 0, 0, 1); }
+IPAddress EthernetClass::dnsServerIP() { return IPAddress(10, 0, 0, 1); }
+int EthernetClass::maintain() { return 0; }
+
+void DNSClient::begin(const IPAddress &server) {}
+
+int DNSClient::getHostByName(const char *host, IPAddress &ip) {
+  ip = IPAddress(10, 0, 0, 77);
+  return 1;
+}
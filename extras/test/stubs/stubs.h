@@ -0,0 +1,59 @@
+/*
+  stubs.h - State of the host stand-ins, driven by the tests
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef stubs_h
+#define stubs_h
+
+#include <string>
+#include <vector>
+#include <Ethernet.h>
+
+// millis() and micros() only move when the test says so
+extern unsigned long stubMillis;
+extern int stubDigital[64];
+extern int stubAnalog[64];
+extern uint8_t stubAttached[64];
+
+// Datagrams sent, with their destination, and the ones to receive,
+// all from 10.0.0.2 at stubRemotePort
+typedef struct StubDatagram
+{
+  std::string dest;
+  std::string data;
+} StubDatagram;
+extern std::vector<StubDatagram> stubSent;
+extern std::vector<std::string> stubReceive;
+extern uint16_t stubRemotePort;
+
+// Sockets: a client connecting gets its request in "in", what the
+// server writes goes to "out". What is in "late" arrives 64 bytes
+// at a time, one chunk per millis() call
+typedef struct StubSocket
+{
+  bool used;
+  bool open;
+  bool accepted;
+  bool outbound;
+  std::string in;
+  std::string late;
+  size_t pos;
+  std::string out;
+} StubSocket;
+extern StubSocket stubSockets[MAX_SOCK_NUM];
+
+int stubConnect(const std::string &request);
+void stubReset();
+
+#endif
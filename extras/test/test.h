@@ -0,0 +1,51 @@
+/*
+  test.h - Checks for the host tests
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef test_h
+#define test_h
+
+#include <stdio.h>
+#include <string>
+#include "stubs.h"
+
+static int testFailures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      testFailures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+    std::string a_ = (actual); \
+    std::string e_ = (expected); \
+    if (a_ != e_) { \
+      printf("%s:%d: %s\n  got:      %s\n  expected: %s\n", __FILE__, __LINE__, #actual, a_.c_str(), e_.c_str()); \
+      testFailures++; \
+    } \
+  } while (0)
+
+#define RUN(test) do { \
+    stubReset(); \
+    test(); \
+  } while (0)
+
+static int testResult(const char *name) {
+  printf("%s: %s\n", name, testFailures == 0 ? "ok" : "FAILED");
+  return testFailures == 0 ? 0 : 1;
+}
+
+#endif
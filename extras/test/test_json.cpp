@@ -0,0 +1,125 @@
+/*
+  test_json.cpp - Host tests of IonoJsonWriter
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include <IonoJson.h>
+#include "test.h"
+
+class StringPrint : public Print
+{
+  public:
+    std::string out;
+
+    size_t write(uint8_t c) {
+      out += (char) c;
+      return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) {
+      out.append((const char *) buffer, size);
+      return size;
+    }
+};
+
+static std::string fixed(int32_t value, uint8_t decimals) {
+  char sVal[14];
+  uint8_t len = IonoJsonWriter::formatFixed(sVal, value, decimals);
+  CHECK(len == strlen(sVal));
+  return sVal;
+}
+
+static std::string integer(int32_t value) {
+  char sVal[12];
+  uint8_t len = IonoJsonWriter::formatInt(sVal, value);
+  CHECK(len == strlen(sVal));
+  return sVal;
+}
+
+static void testFormat() {
+  CHECK_EQ(integer(0), "0");
+  CHECK_EQ(integer(-7), "-7");
+  CHECK_EQ(integer(2147483647), "2147483647");
+  CHECK_EQ(integer(-2147483647 - 1), "-2147483648");
+  CHECK_EQ(fixed(530, 2), "5.30");
+  CHECK_EQ(fixed(-5, 2), "-0.05");
+  CHECK_EQ(fixed(0, 2), "0.00");
+  CHECK_EQ(fixed(-32768, 2), "-327.68");
+  CHECK_EQ(fixed(12345, 0), "12345");
+  CHECK_EQ(fixed(-2147483647 - 1, 2), "-21474836.48");
+}
+
+// Commas go only between members and elements
+static void testDocument() {
+  char buff[128];
+  IonoJsonWriter json(buff, sizeof(buff));
+  json.beginObject();
+  json.key("id");
+  json.string("a\"b\\c");
+  json.key("chg");
+  json.beginArray();
+  json.beginArray();
+  json.string("AV1");
+  json.fixed(530, 2);
+  json.endArray();
+  json.beginArray();
+  json.string("DO1");
+  json.value(1);
+  json.endArray();
+  json.endArray();
+  json.key("empty");
+  json.beginObject();
+  json.endObject();
+  json.endObject();
+  CHECK(!json.overflow());
+  CHECK_EQ(std::string(buff, json.length()),
+      "{\"id\":\"a\\\"b\\\\c\",\"chg\":[[\"AV1\",5.30],[\"DO1\",1]],\"empty\":{}}");
+}
+
+// Without a Print the output is cut at the buffer size
+static void testOverflow() {
+  char buff[8];
+  IonoJsonWriter json(buff, sizeof(buff));
+  json.beginObject();
+  json.key("DO1");
+  json.value(1);
+  CHECK(!json.overflow());
+  CHECK(json.length() == 8);
+  json.endObject();
+  CHECK(json.overflow());
+  CHECK(json.length() == 8);
+}
+
+// With a Print the buffer is sent whenever it fills up
+static void testPrint() {
+  StringPrint out;
+  char buff[4];
+  IonoJsonWriter json(buff, sizeof(buff), &out);
+  json.beginObject();
+  json.key("DO1");
+  json.value(1);
+  json.key("AV1");
+  json.fixed(-1234, 2);
+  json.endObject();
+  json.flush();
+  CHECK(!json.overflow());
+  CHECK_EQ(out.out, "{\"DO1\":1,\"AV1\":-12.34}");
+}
+
+int main() {
+  RUN(testFormat);
+  RUN(testDocument);
+  RUN(testOverflow);
+  RUN(testPrint);
+  return testResult("test_json");
+}
@@ -0,0 +1,97 @@
+/*
+  test_limiter.cpp - Host tests of IonoRateLimiter
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include <IonoRateLimiter.h>
+#include "test.h"
+
+// Without rates set everything goes through
+static void testNoLimit() {
+  IonoRateLimiter limiter;
+  for (int i = 0; i < 100; i++) {
+    CHECK(limiter.allow(DO1, i));
+  }
+  float value;
+  CHECK(limiter.next(&value) == -1);
+  CHECK(limiter.getSuppressed() == 0);
+}
+
+// A burst of 2, then one every 100 ms, only the latest value kept
+static void testChannelRate() {
+  IonoRateLimiter limiter;
+  limiter.setChannelRate(100, 2);
+  CHECK(limiter.allow(AV1, 1));
+  CHECK(limiter.allow(AV1, 2));
+  CHECK(!limiter.allow(AV1, 3));
+  CHECK(!limiter.allow(AV1, 4));
+  CHECK(limiter.allow(AV2, 5));
+  CHECK(limiter.getSuppressed() == 2);
+  CHECK(limiter.getSuppressed(AV1) == 2);
+
+  float value;
+  stubMillis += 99;
+  CHECK(limiter.next(&value) == -1);
+  stubMillis += 1;
+  CHECK(limiter.next(&value) == AV1);
+  CHECK(value == 4);
+  CHECK(limiter.next(&value) == -1);
+
+  // Sent from next(), the token is spent
+  CHECK(!limiter.allow(AV1, 6));
+  stubMillis += 100;
+  CHECK(limiter.next(&value) == AV1);
+  CHECK(value == 6);
+
+  limiter.resetCounters();
+  CHECK(limiter.getSuppressed() == 0);
+  CHECK(limiter.getSuppressed(AV1) == 0);
+}
+
+// The transport budget is shared, throttled channels take turns
+static void testTransportRate() {
+  IonoRateLimiter limiter;
+  limiter.setTransportRate(100, 1);
+  CHECK(limiter.allow(DI1, 1));
+  CHECK(!limiter.allow(DI2, 1));
+  CHECK(!limiter.allow(DI3, 1));
+  CHECK(!limiter.allow(DI1, 0));
+
+  float value;
+  int sent[3];
+  for (int i = 0; i < 3; i++) {
+    stubMillis += 100;
+    sent[i] = limiter.next(&value);
+    CHECK(limiter.next(&value) == -1);
+  }
+  CHECK(sent[0] == DI1 && sent[1] == DI2 && sent[2] == DI3);
+  stubMillis += 100;
+  CHECK(limiter.next(&value) == -1);
+}
+
+// Pins past IONO_RL_CHANNELS, as AO1, are never throttled
+static void testUntracked() {
+  IonoRateLimiter limiter;
+  limiter.setChannelRate(1000, 1);
+  CHECK(limiter.allow(AO1, 1));
+  CHECK(limiter.allow(AO1, 2));
+  CHECK(limiter.getSuppressed(AO1) == 0);
+}
+
+int main() {
+  RUN(testNoLimit);
+  RUN(testChannelRate);
+  RUN(testTransportRate);
+  RUN(testUntracked);
+  return testResult("test_limiter");
+}
@@ -0,0 +1,210 @@
+/*
+  test_udp.cpp - Host tests of IonoUDP
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include <IonoUDP.h>
+#include "test.h"
+
+static EthernetUDP udp;
+
+// Calls process() for the given ms, one call per ms
+static void run(unsigned long ms) {
+  for (unsigned long i = 0; i < ms; i++) {
+    IonoUDP.process();
+    stubMillis++;
+  }
+}
+
+static bool sentPin(const char *name) {
+  std::string key = std::string("\"pin\":\"") + name + "\"";
+  for (size_t i = 0; i < stubSent.size(); i++) {
+    if (stubSent[i].data.find(key) != std::string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The first scan notifies all the 20 channels at once, five
+// times the queue size: each of them must go out at least once
+static void testQueueFull() {
+  static const char *names[] = {"DO1", "DO2", "DO3", "DO4", "DO5", "DO6",
+      "DI1", "DI2", "DI3", "DI4", "DI5", "DI6",
+      "AV1", "AV2", "AV3", "AV4", "AI1", "AI2", "AI3", "AI4"};
+  IonoUDP.begin("t", udp, 7000, 0, 0);
+  run(100);
+  for (int i = 0; i < 20; i++) {
+    CHECK(sentPin(names[i]));
+  }
+}
+
+// A burst of changes on all the 20 channels: no process() call may
+// wait, so time must not move while it runs, and each call sends at
+// most one datagram per channel plus what was already queued
+static void testBurstLatency() {
+  IonoUDP.begin("t", udp, 7000, 0, 0);
+  IonoUDP.setReliable(true);
+  run(100);
+  for (int i = 0; i < 64; i++) {
+    stubDigital[i] = 1;
+    stubAnalog[i] = 512;
+  }
+  size_t most = 0;
+  for (int i = 0; i < 2000; i++) {
+    unsigned long ts = stubMillis;
+    size_t sent = stubSent.size();
+    IonoUDP.process();
+    CHECK(stubMillis == ts);
+    if (stubSent.size() - sent > most) {
+      most = stubSent.size() - sent;
+    }
+    stubMillis++;
+  }
+  CHECK(most > 0);
+  CHECK(most <= 20 + IONO_UDP_TX_QUEUE_SIZE);
+  IonoUDP.setReliable(false);
+}
+
+// With an id long enough to split the changes, every datagram
+// must still fit in IONO_UDP_MAX_DATAGRAM
+static void testDatagramSize() {
+  static std::string id(IONO_UDP_MAX_DATAGRAM - 60, 'x');
+  IonoUDP.begin(id.c_str(), udp, 7000, 0, 0);
+  IonoUDP.setReliable(true);
+  for (int i = 0; i < 64; i++) {
+    stubAnalog[i] = 1023;
+  }
+  run(100);
+  CHECK(stubSent.size() > 0);
+  for (size_t i = 0; i < stubSent.size(); i++) {
+    CHECK(stubSent[i].data.size() <= IONO_UDP_MAX_DATAGRAM);
+  }
+}
+
+// Nothing is acknowledged, so the queue overflows with notifications
+// still pending: the whole state must be sent again afterwards
+static void testResync() {
+  IonoUDP.begin("t", udp, 7000, 0, 0);
+  IonoUDP.setReliable(true);
+  run(10);
+  for (int i = 0; i < 64; i++) {
+    stubDigital[i] = 1;
+    stubAnalog[i] = 512;
+  }
+  stubSent.clear();
+  run(10);
+  bool resync = false;
+  for (size_t i = 0; i < stubSent.size(); i++) {
+    const std::string &data = stubSent[i].data;
+    if (data.find("\"chg\"") != std::string::npos
+        && data.find("\"DO1\"") != std::string::npos
+        && data.find("\"AI4\"") != std::string::npos) {
+      resync = true;
+    }
+  }
+  CHECK(resync);
+
+  // Still no acks: the state is only repeated, resyncs don't push
+  // each other out of the queue
+  stubSent.clear();
+  run(10000);
+  int states = 0;
+  for (size_t i = 0; i < stubSent.size(); i++) {
+    if (stubSent[i].data.find("\"chg\"") != std::string::npos) {
+      states++;
+    }
+  }
+  CHECK(states <= IONO_UDP_MAX_RETRIES + 1);
+  IonoUDP.setReliable(false);
+}
+
+// Sends a command and returns the reply
+static std::string command(const std::string &cmd) {
+  stubSent.clear();
+  stubReceive.push_back(cmd);
+  run(1);
+  return stubSent.empty() ? "" : stubSent.back().data;
+}
+
+// Inputs cannot be set, and a wrong command leaves all the
+// outputs unchanged
+static void testSetOutputsOnly() {
+  IonoUDP.begin("t", udp, 7000, 0, 0);
+  run(10);
+  CHECK_EQ(command("DI1=1"), "error");
+  CHECK_EQ(command("AV1=5.00"), "error");
+  CHECK_EQ(command("DO1=1;AI1=1.00"), "error");
+  CHECK(stubDigital[IONO_PIN_DO1] == 0);
+  CHECK_EQ(command("DO1=1;AO1=2.50"), "ok");
+  CHECK(stubDigital[IONO_PIN_DO1] == 1);
+}
+
+static void testBinarySetOutputsOnly() {
+  IonoUDP.begin("t", udp, 7000, 0, 0, IONO_UDP_BINARY);
+  run(10);
+  // SET DO1 = 1 then SET DI1 = 1
+  CHECK_EQ(command(std::string("\x11\x00\x00\x01\x11\x06\x00\x01", 8)),
+      std::string("\x04\x01", 2));
+  CHECK(stubDigital[IONO_PIN_DO1] == 0);
+  // FLIP AV1
+  CHECK_EQ(command(std::string("\x12\x07", 2)), std::string("\x04\x01", 2));
+  // SET DO1 = 1 then FLIP DO2
+  CHECK_EQ(command(std::string("\x11\x00\x00\x01\x12\x01", 6)),
+      std::string("\x04\x00", 2));
+  CHECK(stubDigital[IONO_PIN_DO1] == 1);
+  CHECK(stubDigital[IONO_PIN_DO2] == 1);
+}
+
+// With the subscriber table full, a SUBSCRIBE fails the whole
+// datagram, the SET before it included
+static void testBinarySubscribeFull() {
+  IonoUDP.begin("t", udp, 7000, 0, 0, IONO_UDP_BINARY);
+  run(10);
+  for (int i = 0; i < IONO_UDP_MAX_SUBSCRIBERS; i++) {
+    stubRemotePort = 6000 + i;
+    CHECK_EQ(command(std::string("\x15\x00\x3c", 3)), std::string("\x04\x00", 2));
+  }
+  stubRemotePort = 5000;
+  // SET DO1 = 1 then SUBSCRIBE for 60 s
+  CHECK_EQ(command(std::string("\x11\x00\x00\x01\x15\x00\x3c", 7)),
+      std::string("\x04\x01", 2));
+  CHECK(stubDigital[IONO_PIN_DO1] == 0);
+  // Leaving needs no entry
+  CHECK_EQ(command(std::string("\x11\x00\x00\x01\x15\x00\x00", 7)),
+      std::string("\x04\x00", 2));
+  CHECK(stubDigital[IONO_PIN_DO1] == 1);
+}
+
+// Before the first stable reading the values are still -99, the
+// longest state there is. Must run first, before anything is read
+static void testStateUnknown() {
+  IonoUDP.begin("t", udp, 7000, 100000, 0);
+  run(10);
+  std::string state = command("state");
+  CHECK_EQ(state.substr(0, 16), "{\"id\":\"t\",\"DO1\":");
+  CHECK(state.find("\"AI4\":-98.99,") != std::string::npos);
+  CHECK_EQ(state.substr(state.size() - 9), ",\"DI6\":0}");
+}
+
+int main() {
+  RUN(testStateUnknown);
+  RUN(testQueueFull);
+  RUN(testBurstLatency);
+  RUN(testDatagramSize);
+  RUN(testResync);
+  RUN(testSetOutputsOnly);
+  RUN(testBinarySetOutputsOnly);
+  RUN(testBinarySubscribeFull);
+  return testResult("test_udp");
+}
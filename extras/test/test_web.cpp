@@ -0,0 +1,243 @@
+/*
+  test_web.cpp - Host tests of IonoWeb
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include <IonoWeb.h>
+#include "test.h"
+
+static void run(unsigned long ms) {
+  for (unsigned long i = 0; i < ms; i++) {
+    IonoWeb.processRequest();
+    Iono.process();
+    stubMillis++;
+  }
+}
+
+// Sends a request and returns the socket, to look at its output
+static int request(const std::string &req) {
+  int sock = stubConnect(req);
+  run(20);
+  return sock;
+}
+
+static std::string status(int sock) {
+  const std::string &out = stubSockets[sock].out;
+  return out.substr(0, out.find("\r\n"));
+}
+
+// The event filter is shared: while a stream is open, other
+// parameters are refused, none or the same ones are fine
+static void testEventsFilter() {
+  int first = request("GET /api/events?st=100&mv=0.5 HTTP/1.1\r\n\r\n");
+  CHECK_EQ(status(first), "HTTP/1.0 200 OK");
+  int other = request("GET /api/events?st=200 HTTP/1.1\r\n\r\n");
+  CHECK_EQ(status(other), "HTTP/1.0 400 Bad Request");
+  int none = request("GET /api/events HTTP/1.1\r\n\r\n");
+  CHECK_EQ(status(none), "HTTP/1.0 200 OK");
+  int same = request("GET /api/events?mv=0.5&st=100 HTTP/1.1\r\n\r\n");
+  CHECK_EQ(status(same), "HTTP/1.0 200 OK");
+  CHECK(stubSockets[first].used);
+
+  stubSockets[first].open = false;
+  stubSockets[none].open = false;
+  stubSockets[same].open = false;
+  run(20);
+}
+
+// Values that don't fit are refused, not cut
+static void testLongParams() {
+  std::string host(40, 'h');
+  int sock = request("GET /api/subscribe?host=" + host + " HTTP/1.1\r\n\r\n");
+  CHECK_EQ(status(sock), "HTTP/1.0 400 Bad Request");
+  sock = request("GET /api/subscribe?host=h&cmd=/" + std::string(31, 'c') + " HTTP/1.1\r\n\r\n");
+  CHECK_EQ(status(sock), "HTTP/1.0 400 Bad Request");
+  sock = request("GET /api/history?ch=AV1&from=1234567890123 HTTP/1.1\r\n\r\n");
+  CHECK_EQ(status(sock), "HTTP/1.0 400 Bad Request");
+  sock = request("GET /api/set?DO1=1.000000000 HTTP/1.1\r\n\r\n");
+  CHECK_EQ(status(sock), "HTTP/1.0 400 Bad Request");
+  sock = request("GET /api/history?ch=AV1&from=3600000 HTTP/1.1\r\n\r\n");
+  CHECK_EQ(status(sock), "HTTP/1.1 200 OK");
+}
+
+static std::string body(int sock) {
+  const std::string &out = stubSockets[sock].out;
+  size_t pos = out.find("\r\n\r\n");
+  return pos == std::string::npos ? "" : out.substr(pos + 4);
+}
+
+// A full batch is longer than WEBDUINO_MAX_BODY_WAIT, so it is read
+// while it is still coming in
+static void testBatchLarge() {
+  static const char *names[] = {"DO1", "DO2", "DO3", "DO4", "DO5", "DO6", "AO1"};
+  std::string batch = "{";
+  for (int i = 0; i < IONO_WEB_BATCH_SIZE; i++) {
+    batch += std::string(i > 0 ? "," : "") + "\"" + names[i % 7] + "\":{\"value\":1,\"delay\":0,\"pulse\":0}";
+  }
+  batch += "}";
+  CHECK(batch.size() > WEBDUINO_MAX_BODY_WAIT);
+
+  std::string headers = "POST /api/batch HTTP/1.1\r\nContent-Length: " + std::to_string(batch.size()) + "\r\n\r\n";
+  int sock = stubConnect(headers + batch.substr(0, 200));
+  stubSockets[sock].late = batch.substr(200);
+  run(20);
+  CHECK_EQ(status(sock), "HTTP/1.0 200 OK");
+  CHECK_EQ(body(sock), "{\"outputs\":32,\"scheduled\":0}");
+}
+
+static int post(const std::string &path, const std::string &body) {
+  return request("POST " + path + " HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+}
+
+// DO3 goes on after 2 s and back off 500 ms later
+static void testBatchForm() {
+  int sock = post("/api/batch", "DO1=1&DO2=f&AO1=5.30&DO3=1,2000,500");
+  CHECK_EQ(status(sock), "HTTP/1.0 200 OK");
+  CHECK_EQ(body(sock), "{\"outputs\":4,\"scheduled\":2}");
+  CHECK(Iono.read(DO1) == 1);
+  CHECK(Iono.read(DO2) == 1);
+  CHECK(Iono.read(AO1) > 5.29 && Iono.read(AO1) < 5.31);
+  CHECK(Iono.read(DO3) == 0);
+  run(2000);
+  CHECK(Iono.read(DO3) == 1);
+  run(500);
+  CHECK(Iono.read(DO3) == 0);
+}
+
+static void testBatchJson() {
+  int sock = post("/api/batch", " { \"DO1\" : true, \"DO2\":\"1\",\n\"AO1\":2.5,"
+      "\"DO4\":{\"pulse\":100,\"value\":1} }");
+  CHECK_EQ(status(sock), "HTTP/1.0 200 OK");
+  CHECK_EQ(body(sock), "{\"outputs\":4,\"scheduled\":1}");
+  CHECK(Iono.read(DO1) == 1);
+  CHECK(Iono.read(DO2) == 1);
+  CHECK(Iono.read(AO1) > 2.49 && Iono.read(AO1) < 2.51);
+  CHECK(Iono.read(DO4) == 1);
+  run(100);
+  CHECK(Iono.read(DO4) == 0);
+}
+
+// A wrong entry anywhere fails the whole batch, nothing is applied
+static void testBatchInvalid() {
+  static const char *bodies[] = {
+    "DO1=1&DI1=1",
+    "DO1=1&AO1=10.01",
+    "DO1=1&DO2=2",
+    "DO1=1&DO2=1,x",
+    "{\"DO1\":1,\"AV1\":1}",
+    "{\"DO1\":1,\"DO2\":{\"delay\":100}}",
+    "{\"DO1\":1,\"DO2\":{\"value\":1,\"other\":0}}",
+    "{\"DO1\":1,}",
+    "{\"DO1\":1",
+    "{\"DO1\":\"a\\\"b\"}",
+  };
+  float ao1 = Iono.read(AO1);
+  for (unsigned int i = 0; i < sizeof(bodies) / sizeof(bodies[0]); i++) {
+    int sock = post("/api/batch", bodies[i]);
+    CHECK_EQ(status(sock), "HTTP/1.0 400 Bad Request");
+    CHECK(Iono.read(DO1) == 0);
+    CHECK(Iono.read(DO2) == 0);
+    CHECK(Iono.read(AO1) == ao1);
+  }
+  run(200);
+  CHECK(Iono.read(DO2) == 0);
+}
+
+// The state is read in full before it is served: a change made
+// right before the request is in it, and a new ETag with it
+static void testStateFresh() {
+  run(20);
+  int sock = request("GET /api/state HTTP/1.1\r\n\r\n");
+  CHECK_EQ(status(sock), "HTTP/1.0 200 OK");
+  const std::string &out = stubSockets[sock].out;
+  size_t pos = out.find("ETag: ");
+  CHECK(pos != std::string::npos);
+  std::string etag = out.substr(pos + 6, out.find("\r\n", pos) - pos - 6);
+
+  stubDigital[IONO_PIN_DI6] = !stubDigital[IONO_PIN_DI6];
+  bool di6 = stubDigital[IONO_PIN_DI6];
+  sock = stubConnect("GET /api/state HTTP/1.1\r\nIf-None-Match: " + etag + "\r\n\r\n");
+  IonoWeb.processRequest();
+  CHECK_EQ(status(sock), "HTTP/1.0 200 OK");
+  CHECK(body(sock).find(di6 ? "\"I6\":{\"D\":1}" : "\"I6\":{\"D\":0}") != std::string::npos);
+}
+
+static std::string hundredths(float value) {
+  char sVal[14];
+  IonoJsonWriter::formatFixed(sVal, (int16_t) (value * 100 + 0.5), 2);
+  return sVal;
+}
+
+// One sample of AV1 every IONO_WEB_HISTORY_ITVL ms, six rising values
+// in three points: each the min and max of two samples
+static void testHistory() {
+  std::string v[6];
+  for (int k = 0; k < 6; k++) {
+    stubAnalog[IONO_PIN_AV1] = 100 + k * 100;
+    v[k] = hundredths(Iono.read(AV1));
+    run(IONO_WEB_HISTORY_ITVL);
+  }
+  CHECK(v[0] != v[5]);
+  int sock = request("GET /api/history?ch=AV1&from=60000&points=3 HTTP/1.1\r\n\r\n");
+  std::string res = body(sock);
+  CHECK(res.find("\"ch\":\"AV1\"") != std::string::npos);
+  for (int k = 0; k < 6; k += 2) {
+    CHECK(res.find("," + v[k] + "," + v[k + 1] + "]") != std::string::npos);
+  }
+  CHECK(res.find("," + v[1] + "," + v[2] + "]") == std::string::npos);
+}
+
+// The outbound request sent since the socket was opened
+static std::string sentURL() {
+  for (int i = 0; i < MAX_SOCK_NUM; i++) {
+    if (stubSockets[i].outbound && !stubSockets[i].out.empty()) {
+      std::string out = stubSockets[i].out;
+      stubSockets[i] = StubSocket();
+      return out.substr(0, out.find("\r\n"));
+    }
+  }
+  return "";
+}
+
+// A sketch calling only Iono.process() still gets its notifications,
+// sent from the callback. Must run before processRequest() is called
+static void testSubscribeUnpolled() {
+  IonoWeb.subscribe(0, 0.1, (char *) "10.0.0.3", 8080, (char *) "/bar", 1, 1, 1, 1);
+  for (int i = 0; i < 5; i++) {
+    Iono.process();
+    stubMillis++;
+  }
+  CHECK(sentURL().find("GET /bar?") == 0);
+
+  stubDigital[IONO_PIN_DI1] = !stubDigital[IONO_PIN_DI1];
+  for (int i = 0; i < 5; i++) {
+    Iono.process();
+    stubMillis++;
+  }
+  CHECK_EQ(sentURL(), stubDigital[IONO_PIN_DI1] ? "GET /bar?DI1=1 HTTP/1.1" : "GET /bar?DI1=0 HTTP/1.1");
+  CHECK(IonoWeb.subscribe(0, 0.1, (char *) "10.0.0.3", 8080, (char *) "/bar", 1, 1, 1, 1, 0));
+}
+
+int main() {
+  IonoWeb.begin(80);
+  RUN(testSubscribeUnpolled);
+  RUN(testEventsFilter);
+  RUN(testLongParams);
+  RUN(testBatchLarge);
+  RUN(testBatchForm);
+  RUN(testBatchJson);
+  RUN(testBatchInvalid);
+  RUN(testHistory);
+  RUN(testStateFresh);
+  return testResult("test_web");
+}
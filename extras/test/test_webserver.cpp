@@ -0,0 +1,162 @@
+/*
+  test_webserver.cpp - Host tests of the WebServer request parser
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include <WebServer.h>
+#include "test.h"
+
+static WebServer webserver("", 80);
+static std::string body;
+
+// Echoes the body back
+static void echoCmd(WebServer &server, WebServer::ConnectionType type, char *url_tail, bool tail_complete) {
+  body.clear();
+  int ch;
+  while ((ch = server.read()) != -1) {
+    body += (char) ch;
+  }
+  server.httpSuccess("text/plain");
+  server.print(body.c_str());
+}
+
+// Sends a request and returns what the server wrote back
+static std::string request(const std::string &req) {
+  int sock = stubConnect(req);
+  for (int i = 0; i < 10; i++) {
+    webserver.processConnection();
+    stubMillis++;
+  }
+  return stubSockets[sock].out;
+}
+
+static std::string status(const std::string &response) {
+  return response.substr(0, response.find("\r\n"));
+}
+
+static void testContentLength() {
+  std::string res = request("POST /echo HTTP/1.0\r\nContent-Length: 5\r\n\r\nhello");
+  CHECK_EQ(status(res), "HTTP/1.0 200 OK");
+  CHECK_EQ(body, "hello");
+}
+
+// Too large to be told apart from a smaller one: refused and closed
+static void testContentLengthTooLarge() {
+  body = "none";
+  int sock = stubConnect("POST /echo HTTP/1.1\r\nContent-Length: 50000\r\n\r\nhello");
+  for (int i = 0; i < 10; i++) {
+    webserver.processConnection();
+  }
+  CHECK_EQ(status(stubSockets[sock].out), "HTTP/1.0 413 Payload Too Large");
+  CHECK(!stubSockets[sock].used);
+  CHECK_EQ(body, "none");
+}
+
+static void testContentLengthInvalid() {
+  body = "none";
+  int sock = stubConnect("POST /echo HTTP/1.1\r\nContent-Length: 5x\r\n\r\nhello");
+  for (int i = 0; i < 10; i++) {
+    webserver.processConnection();
+  }
+  CHECK_EQ(status(stubSockets[sock].out), "HTTP/1.0 400 Bad Request");
+  CHECK(!stubSockets[sock].used);
+  CHECK_EQ(body, "none");
+}
+
+// Accepts the upgrade
+static void wsCmd(WebServer &server, WebServer::ConnectionType type, char *url_tail, bool tail_complete) {
+  if (!server.httpWebSocket()) {
+    server.httpFail();
+  }
+}
+
+// Echoes the messages back
+static void wsMessage(WebServer &server, char *message, int length, bool binary) {
+  server.writeWebSocket((const uint8_t *) message, length, binary);
+}
+
+// The key and accept value of the example in RFC 6455
+static void testWebSocket() {
+  std::string res = request("GET /ws HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n");
+  CHECK_EQ(status(res), "HTTP/1.1 101 Switching Protocols");
+  CHECK(res.find("\r\nSec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != std::string::npos);
+  CHECK(webserver.webSocketCount() == 1);
+
+  // A masked "Hello" text frame, the reply comes back unmasked
+  int sock = 0;
+  while (!stubSockets[sock].used) {
+    sock++;
+  }
+  stubSockets[sock].out.clear();
+  stubSockets[sock].in += std::string("\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58", 11);
+  for (int i = 0; i < 10; i++) {
+    webserver.processConnection();
+  }
+  CHECK_EQ(stubSockets[sock].out, std::string("\x81\x05Hello", 7));
+
+  stubSockets[sock].open = false;
+  webserver.processConnection();
+  CHECK(webserver.webSocketCount() == 0);
+}
+
+// Without a key there is nothing to upgrade
+static void testWebSocketNoKey() {
+  std::string res = request("GET /ws HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n\r\n");
+  CHECK_EQ(status(res), "HTTP/1.0 400 Bad Request");
+  CHECK(webserver.webSocketCount() == 0);
+}
+
+// Answers 200 to user:pass, 400 to anyone else
+static void authCmd(WebServer &server, WebServer::ConnectionType type, char *url_tail, bool tail_complete) {
+  if (server.checkCredentials("dXNlcjpwYXNz")) {
+    server.httpSuccess("text/plain");
+  } else {
+    server.httpFail();
+  }
+}
+
+// The credentials buffer is shared: the second client waits for the
+// first one to be served instead of overwriting its header
+static void testAuthorizationShared() {
+  int a = stubConnect("GET /auth HTTP/1.0\r\nAuthorization: Basic dXNlcj");
+  for (int i = 0; i < 5; i++) {
+    webserver.processConnection();
+  }
+  int b = stubConnect("GET /auth HTTP/1.0\r\nAuthorization: Basic d3Jvbmc6eA==\r\n\r\n");
+  for (int i = 0; i < 5; i++) {
+    webserver.processConnection();
+  }
+  CHECK(stubSockets[b].out.empty());
+  stubSockets[a].in += "pwYXNz\r\n\r\n";
+  for (int i = 0; i < 10; i++) {
+    webserver.processConnection();
+  }
+  CHECK_EQ(status(stubSockets[a].out), "HTTP/1.0 200 OK");
+  CHECK_EQ(status(stubSockets[b].out), "HTTP/1.0 400 Bad Request");
+}
+
+int main() {
+  webserver.begin();
+  webserver.addCommand("echo", &echoCmd);
+  webserver.addCommand("ws", &wsCmd);
+  webserver.addCommand("auth", &authCmd);
+  webserver.setWebSocketCommand(&wsMessage);
+  RUN(testContentLength);
+  RUN(testContentLengthTooLarge);
+  RUN(testContentLengthInvalid);
+  RUN(testWebSocket);
+  RUN(testWebSocketNoKey);
+  RUN(testAuthorizationShared);
+  return testResult("test_webserver");
+}
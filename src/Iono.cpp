@@ -14,6 +14,17 @@
 */
 
 #include "Iono.h"
+#include "IonoMetrics.h"
+
+#if defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_MEGAAVR)
+#include <avr/sleep.h>
+#elif defined(ARDUINO_ARCH_RP2040)
+#include <pico/time.h>
+#endif
+
+#ifndef NOT_AN_INTERRUPT
+#define NOT_AN_INTERRUPT -1
+#endif
 
 #if defined(IONO_MKR) || defined(ARDUINO_SAMD_ZERO)
 #define ANALOG_READ_BITS 12
@@ -44,6 +55,8 @@
 #define ANALOG_READ_MAX ((1 << ANALOG_READ_BITS) - 1)
 #define ANALOG_WRITE_MAX ((1 << ANALOG_WRITE_BITS) - 1)
 
+volatile bool IonoClass::_wake = false;
+
 IonoClass::IonoClass() {
   _pinMap[DO1] = IONO_PIN_DO1;
   _pinMap[DO2] = IONO_PIN_DO2;
@@ -76,6 +89,25 @@ IonoClass::IonoClass() {
   _pinMap[DI6] = IONO_PIN_DI6;
   _pinMap[AO1] = IONO_PIN_AO1;
 
+  _inputs[0] = &_i1;
+  _inputs[1] = &_i2;
+  _inputs[2] = &_i3;
+  _inputs[3] = &_i4;
+  _inputs[4] = &_i5;
+  _inputs[5] = &_i6;
+  _inputs[6] = &_o1;
+  _inputs[7] = &_o2;
+  _inputs[8] = &_o3;
+  _inputs[9] = &_o4;
+  _inputs[10] = &_o5;
+  _inputs[11] = &_o6;
+  _inputs[12] = &_a1;
+
+  _deadlinePending = false;
+  _wakeIrqs = 0;
+  _wakeMask = 0;
+  resetIdleStats();
+
   setup();
 }
 
@@ -227,6 +259,7 @@ void IonoClass::subscribeDigital(uint8_t pin, unsigned long stableTime, Callback
   (*input).callback = callback;
   (*input).value = -1;
   (*input).lastTS = millis();
+  (*input).changing = false;
 }
 
 void IonoClass::subscribeAnalog(uint8_t pin, unsigned long stableTime, float minVariation, Callback *callback) {
@@ -267,6 +300,7 @@ void IonoClass::subscribeAnalog(uint8_t pin, unsigned long stableTime, float min
   (*input).callback = callback;
   (*input).value = -100;
   (*input).lastTS = millis();
+  (*input).changing = false;
 }
 
 void IonoClass::linkDiDo(uint8_t dix, uint8_t dox, uint8_t mode, unsigned long stableTime) {
@@ -312,9 +346,15 @@ void IonoClass::linkDiDo(uint8_t dix, uint8_t dox, uint8_t mode, unsigned long s
   (*input).linkMode = mode;
   (*input).value = -1;
   (*input).lastTS = millis();
+  (*input).changing = false;
 }
 
 void IonoClass::process() {
+#if IONO_METRICS
+  unsigned long start = micros();
+  ionoMetricsLoop(start);
+#endif
+  _deadlinePending = false;
   check(&_i1);
   check(&_i2);
   check(&_i3);
@@ -328,10 +368,13 @@ void IonoClass::process() {
   check(&_o5);
   check(&_o6);
   check(&_a1);
+#if IONO_METRICS
+  ionoMetricsTime(&IonoMetrics.scan, micros() - start);
+#endif
 }
 
 void IonoClass::check(CallbackMap *input) {
-  if ((*input).callback != NULL || (*input).linkedPin >= 0) {
+  if (isActive(input)) {
     float val = read((*input).pin);
     unsigned long ts = millis();
 
@@ -352,12 +395,13 @@ void IonoClass::check(CallbackMap *input) {
 
       if (diff >= (*input).minVariation || val == 0 || val == maxVal) {
         if ((ts - (*input).lastTS) >= (*input).stableTime) {
+          (*input).changing = false;
           (*input).value = val;
           (*input).lastTS = ts;
           if ((*input).callback != NULL) {
             (*input).callback((*input).pin, val);
           }
-          if ((*input).linkedPin >= 0) {
+          if ((*input).linkMode != 0) {
             switch ((*input).linkMode) {
               case LINK_FOLLOW:
                 write((*input).linkedPin, val);
@@ -380,16 +424,204 @@ void IonoClass::check(CallbackMap *input) {
                 break;
             }
           }
+        } else {
+          (*input).changing = true;
+          unsigned long deadline = (*input).lastTS + (*input).stableTime;
+          if (!_deadlinePending || (long) (deadline - _deadline) < 0) {
+            _deadline = deadline;
+            _deadlinePending = true;
+          }
         }
       } else {
+        (*input).changing = false;
         (*input).lastTS = ts;
       }
     } else {
+      (*input).changing = false;
       (*input).lastTS = ts;
     }
   }
 }
 
+// Sleeps until maxTime elapses, the next pending stable time
+// expires or a subscribed digital input changes. Inputs are
+// not sampled while sleeping, so analog subscriptions still
+// require maxTime to be smaller than their stable time.
+// Digital inputs are polled on every tick, those enabled with
+// setWakeInterrupt() also wake it up through their interrupt.
+void IonoClass::idle(unsigned long maxTime) {
+  unsigned long start = millis();
+  _awakeTime += start - _awakeTS;
+
+  if (_deadlinePending) {
+    long left = (long) (_deadline - start);
+    if (left <= 0) {
+      _awakeTS = start;
+      return;
+    }
+    if ((unsigned long) left < maxTime) {
+      maxTime = left;
+    }
+  }
+
+  _wake = false;
+  bool allIrqs = armWake(true);
+  unsigned long elapsed;
+  while (!_wake && (elapsed = millis() - start) < maxTime) {
+    // Not all the inputs raise an interrupt, poll them on every tick
+    if (digitalChanged()) {
+      break;
+    }
+    sleep(allIrqs ? maxTime - elapsed : 1);
+  }
+  armWake(false);
+
+  unsigned long ts = millis();
+
+  // Inputs were stable while sleeping: restart their stable time
+  // from the wake-up, as a continuous process() loop would have
+  for (int i = 0; i < 13; i++) {
+    if (isActive(_inputs[i]) && !(*_inputs[i]).changing) {
+      (*_inputs[i]).lastTS = ts;
+    }
+  }
+
+  _sleepTime += ts - start;
+  _awakeTS = ts;
+}
+
+unsigned long IonoClass::getSleepTime() {
+  return _sleepTime;
+}
+
+unsigned long IonoClass::getAwakeTime() {
+  return _awakeTime;
+}
+
+void IonoClass::resetIdleStats() {
+  _sleepTime = 0;
+  _awakeTime = 0;
+  _awakeTS = millis();
+}
+
+bool IonoClass::isActive(CallbackMap *input) {
+  return (*input).callback != NULL || (*input).linkMode != 0;
+}
+
+bool IonoClass::isDigitalInput(uint8_t pin) {
+  return pin == DI1 || pin == DI2 || pin == DI3 || pin == DI4 || pin == DI5 || pin == DI6;
+}
+
+// While idle() sleeps, the interrupt of the given DI wakes it
+// up as soon as the input changes, instead of at the next tick.
+// Off by default: idle() attaches its own handler and detaches
+// it when done, so don't enable pins the sketch attaches to
+void IonoClass::setWakeInterrupt(uint8_t pin, bool enabled) {
+  uint8_t bit;
+
+  switch (pin) {
+    case DI1:
+      bit = 1 << 0;
+      break;
+
+    case DI2:
+      bit = 1 << 1;
+      break;
+
+    case DI3:
+      bit = 1 << 2;
+      break;
+
+    case DI4:
+      bit = 1 << 3;
+      break;
+
+    case DI5:
+      bit = 1 << 4;
+      break;
+
+    case DI6:
+      bit = 1 << 5;
+      break;
+
+    default:
+      return;
+  }
+
+  if (enabled) {
+    _wakeMask |= bit;
+  } else {
+    _wakeMask &= ~bit;
+  }
+}
+
+// Only the interrupts attached here are detached, so that
+// those of the sketch on other pins are left alone. Returns
+// true if every subscribed DI has its interrupt attached
+bool IonoClass::armWake(bool enable) {
+  bool all = true;
+  for (int i = 0; i < 6; i++) {
+    CallbackMap *input = _inputs[i];
+    if (enable) {
+      if (!isActive(input) || !isDigitalInput((*input).pin)) {
+        continue;
+      }
+      int irq = digitalPinToInterrupt(_pinMap[(*input).pin]);
+      if (!(_wakeMask & (1 << i)) || irq == NOT_AN_INTERRUPT) {
+        all = false;
+        continue;
+      }
+      attachInterrupt(irq, onWake, CHANGE);
+      _wakeIrqs |= 1 << i;
+    } else if (_wakeIrqs & (1 << i)) {
+      detachInterrupt(digitalPinToInterrupt(_pinMap[(*input).pin]));
+    }
+  }
+  if (!enable) {
+    _wakeIrqs = 0;
+  }
+  return all;
+}
+
+bool IonoClass::digitalChanged() {
+  for (int i = 0; i < 6; i++) {
+    CallbackMap *input = _inputs[i];
+    if (isActive(input) && isDigitalInput((*input).pin) && !(*input).changing) {
+      if (digitalRead(_pinMap[(*input).pin]) != (*input).value) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void IonoClass::sleep(unsigned long timeLeft) {
+  // Only the RP2040 needs to know how long it can wait
+  (void) timeLeft;
+#if defined(ARDUINO_ARCH_SAMD)
+  // Idle mode: the CPU is halted while SysTick keeps millis()
+  // running and wakes it up every millisecond. Standby would
+  // stop the time base the stable times are counted on.
+  PM->SLEEP.reg = PM_SLEEP_IDLE_CPU;
+  SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+  __DSB();
+  __WFI();
+#elif defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_MEGAAVR)
+  // Woken up by the timer 0 overflow too
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_mode();
+#elif defined(ARDUINO_ARCH_RP2040)
+  // Any GPIO interrupt generates an event, no periodic tick
+  best_effort_wfe_or_timeout(make_timeout_time_ms(timeLeft));
+#else
+  delay(1);
+#endif
+}
+
+void IonoClass::onWake() {
+  _wake = true;
+}
+
 float IonoClass::read(uint8_t pin) {
   if (pin >= DO1 && pin <= DO6) {
     return digitalRead(_pinMap[pin]);
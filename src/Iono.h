@@ -197,6 +197,11 @@ class IonoClass
     void subscribeAnalog(uint8_t pin, unsigned long stableTime, float minVariation, Callback *callback);
     void linkDiDo(uint8_t dix, uint8_t dox, uint8_t mode, unsigned long stableTime);
     void process();
+    void idle(unsigned long maxTime);
+    void setWakeInterrupt(uint8_t pin, bool enabled);
+    unsigned long getSleepTime();
+    unsigned long getAwakeTime();
+    void resetIdleStats();
     void serialTxEn(bool enabled);
 
   private:
@@ -212,6 +217,7 @@ class IonoClass
       uint8_t linkMode;
       float value;
       unsigned long lastTS;
+      bool changing;
     } CallbackMap;
     CallbackMap _i1;
     CallbackMap _i2;
@@ -226,8 +232,23 @@ class IonoClass
     CallbackMap _o5;
     CallbackMap _o6;
     CallbackMap _a1;
+    CallbackMap *_inputs[13];
+    bool _deadlinePending;
+    unsigned long _deadline;
+    unsigned long _sleepTime;
+    unsigned long _awakeTime;
+    unsigned long _awakeTS;
+    uint8_t _wakeIrqs;
+    uint8_t _wakeMask;
+    static volatile bool _wake;
 
     void check(CallbackMap *input);
+    bool isActive(CallbackMap *input);
+    bool isDigitalInput(uint8_t pin);
+    bool armWake(bool enable);
+    bool digitalChanged();
+    void sleep(unsigned long timeLeft);
+    static void onWake();
 };
 
 extern IonoClass Iono;
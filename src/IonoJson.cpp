@@ -0,0 +1,195 @@
+/*
+  IonoJson.cpp - Compact JSON writer for Iono Uno/MKR/RP
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include "IonoJson.h"
+
+IonoJsonWriter::IonoJsonWriter(char *buff, uint16_t size, Print *out) {
+  _buff = buff;
+  _size = size;
+  _len = 0;
+  _out = out;
+  _comma = false;
+  _overflow = false;
+}
+
+void IonoJsonWriter::beginObject() {
+  separate();
+  put('{');
+  _comma = false;
+}
+
+void IonoJsonWriter::endObject() {
+  put('}');
+  _comma = true;
+}
+
+void IonoJsonWriter::beginArray() {
+  separate();
+  put('[');
+  _comma = false;
+}
+
+void IonoJsonWriter::endArray() {
+  put(']');
+  _comma = true;
+}
+
+// Names are not escaped
+void IonoJsonWriter::key(const char *name) {
+  separate();
+  put('"');
+  raw(name);
+  put('"');
+  put(':');
+  _comma = false;
+}
+
+void IonoJsonWriter::keyP(const char *name) {
+  separate();
+  put('"');
+  rawP(name);
+  put('"');
+  put(':');
+  _comma = false;
+}
+
+void IonoJsonWriter::value(int32_t value) {
+  char sVal[12];
+  separate();
+  raw(sVal, formatInt(sVal, value));
+  _comma = true;
+}
+
+void IonoJsonWriter::fixed(int32_t value, uint8_t decimals) {
+  char sVal[14];
+  separate();
+  raw(sVal, formatFixed(sVal, value, decimals));
+  _comma = true;
+}
+
+// Only quotes and backslashes are escaped
+void IonoJsonWriter::string(const char *str) {
+  separate();
+  put('"');
+  for (; *str != '\0'; str++) {
+    if (*str == '"' || *str == '\\') {
+      put('\\');
+    }
+    put(*str);
+  }
+  put('"');
+  _comma = true;
+}
+
+void IonoJsonWriter::raw(const char *str) {
+  while (*str != '\0') {
+    put(*str++);
+  }
+}
+
+void IonoJsonWriter::rawP(const char *str) {
+  char c;
+  while ((c = pgm_read_byte(str++)) != '\0') {
+    put(c);
+  }
+}
+
+void IonoJsonWriter::raw(const char *data, uint16_t len) {
+  while (len-- > 0) {
+    put(*data++);
+  }
+}
+
+void IonoJsonWriter::flush() {
+  if (_out != NULL && _len > 0) {
+    _out->write((const uint8_t *) _buff, _len);
+    _len = 0;
+  }
+}
+
+uint16_t IonoJsonWriter::length() {
+  return _len;
+}
+
+// True if something did not fit in a buffer without Print
+bool IonoJsonWriter::overflow() {
+  return _overflow;
+}
+
+// Returns the string length, at most 11
+uint8_t IonoJsonWriter::formatInt(char *sVal, int32_t value) {
+  char digits[10];
+  uint8_t n = 0;
+  uint8_t i = 0;
+  uint32_t u = value;
+  if (value < 0) {
+    sVal[i++] = '-';
+    u = 0 - u;
+  }
+  do {
+    digits[n++] = '0' + u % 10;
+    u /= 10;
+  } while (u != 0);
+  while (n > 0) {
+    sVal[i++] = digits[--n];
+  }
+  sVal[i] = '\0';
+  return i;
+}
+
+// E.g. 530 with 2 decimals is "5.30", -5 is "-0.05".
+// Returns the string length, at most 13
+uint8_t IonoJsonWriter::formatFixed(char *sVal, int32_t value, uint8_t decimals) {
+  if (decimals == 0) {
+    return formatInt(sVal, value);
+  }
+
+  uint8_t i = 0;
+  uint32_t u = value;
+  if (value < 0) {
+    sVal[i++] = '-';
+    u = 0 - u;
+  }
+  uint32_t scale = 1;
+  for (uint8_t d = 0; d < decimals; d++) {
+    scale *= 10;
+  }
+  i += formatInt(sVal + i, u / scale);
+  sVal[i++] = '.';
+  u %= scale;
+  for (uint8_t d = decimals; d > 0; d--) {
+    scale /= 10;
+    sVal[i++] = '0' + (u / scale) % 10;
+  }
+  sVal[i] = '\0';
+  return i;
+}
+
+void IonoJsonWriter::put(char c) {
+  if (_len == _size) {
+    if (_out == NULL) {
+      _overflow = true;
+      return;
+    }
+    flush();
+  }
+  _buff[_len++] = c;
+}
+
+void IonoJsonWriter::separate() {
+  if (_comma) {
+    put(',');
+  }
+}
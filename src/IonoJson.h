@@ -0,0 +1,60 @@
+/*
+  IonoJson.h - Compact JSON writer for Iono Uno/MKR/RP
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef IonoJson_h
+#define IonoJson_h
+
+#include <Arduino.h>
+
+// Writes JSON into a caller's buffer, commas between members are
+// added as needed. Numbers are integers or fixed-point integers,
+// e.g. fixed(530, 2) gives 5.30, never floats.
+// With a Print the buffer is sent to it whenever it fills up and
+// by flush(), without one the output is truncated to the buffer
+class IonoJsonWriter
+{
+  public:
+    IonoJsonWriter(char *buff, uint16_t size, Print *out = NULL);
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    void key(const char *name);
+    void keyP(const char *name);
+    void value(int32_t value);
+    void fixed(int32_t value, uint8_t decimals);
+    void string(const char *str);
+    void raw(const char *str);
+    void rawP(const char *str);
+    void raw(const char *data, uint16_t len);
+    void flush();
+    uint16_t length();
+    bool overflow();
+    static uint8_t formatInt(char *sVal, int32_t value);
+    static uint8_t formatFixed(char *sVal, int32_t value, uint8_t decimals);
+
+  private:
+    char *_buff;
+    uint16_t _size;
+    uint16_t _len;
+    Print *_out;
+    bool _comma;
+    bool _overflow;
+
+    void put(char c);
+    void separate();
+};
+
+#endif
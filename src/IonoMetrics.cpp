@@ -0,0 +1,63 @@
+/*
+  IonoMetrics.cpp - Runtime counters for Iono Uno/MKR/RP
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include "IonoMetrics.h"
+
+#if IONO_METRICS
+
+#ifdef __AVR__
+extern char *__brkval;
+extern char __heap_start;
+#elif defined(__arm__)
+extern "C" char *sbrk(int incr);
+#endif
+
+IonoMetricsData IonoMetrics;
+
+void ionoMetricsTime(IonoTiming *timing, unsigned long us) {
+  timing->count++;
+  timing->sumUs += us;
+  if (us > timing->maxUs) {
+    timing->maxUs = us;
+  }
+}
+
+// Called at each pass of the main loop, times the previous one
+void ionoMetricsLoop(unsigned long now) {
+  if (IonoMetrics.loopTS != 0) {
+    ionoMetricsTime(&IonoMetrics.loop, now - IonoMetrics.loopTS);
+  }
+  IonoMetrics.loopTS = now | 1;
+}
+
+void ionoMetricsResetMax() {
+  IonoMetrics.loop.maxUs = 0;
+  IonoMetrics.scan.maxUs = 0;
+}
+
+// Space between the heap and the stack, -1 if unknown
+long ionoFreeMemory() {
+  char top;
+#ifdef __AVR__
+  return &top - (__brkval != NULL ? __brkval : &__heap_start);
+#elif defined(__arm__)
+  return &top - sbrk(0);
+#else
+  (void) top;
+  return -1;
+#endif
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+  IonoMetrics.h - Runtime counters for Iono Uno/MKR/RP
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef IonoMetrics_h
+#define IonoMetrics_h
+
+#include <Arduino.h>
+
+// Set to 0 to compile the counters and the /metrics page out
+#ifndef IONO_METRICS
+#ifdef __AVR__
+#define IONO_METRICS 0
+#else
+#define IONO_METRICS 1
+#endif
+#endif
+
+#define IONO_METRIC_HTTP 0
+#define IONO_METRIC_EVENTS 1
+#define IONO_METRIC_UDP 2
+#define IONO_METRIC_TRANSPORTS 3
+
+#if IONO_METRICS
+
+#define IONO_METRIC_INC(counter) (IonoMetrics.counter++)
+#define IONO_METRIC_ADD(counter, n) (IonoMetrics.counter += (n))
+
+typedef struct IonoTiming
+{
+  uint32_t count;
+  uint64_t sumUs;
+  uint32_t maxUs;
+} IonoTiming;
+
+// Maxima are since the last reset, i.e. the last scrape
+typedef struct IonoMetricsData
+{
+  IonoTiming loop;
+  IonoTiming scan;
+  unsigned long loopTS;
+  uint32_t notifications[IONO_METRIC_TRANSPORTS];
+  uint32_t rateLimited;
+  uint32_t dropped;
+  uint32_t coalesced;
+  uint32_t modbusFrames;
+  uint32_t modbusErrors;
+  uint32_t httpRequests;
+} IonoMetricsData;
+
+extern IonoMetricsData IonoMetrics;
+
+void ionoMetricsTime(IonoTiming *timing, unsigned long us);
+void ionoMetricsLoop(unsigned long now);
+void ionoMetricsResetMax();
+long ionoFreeMemory();
+
+#else
+
+#define IONO_METRIC_INC(counter)
+#define IONO_METRIC_ADD(counter, n)
+
+#endif
+
+#endif
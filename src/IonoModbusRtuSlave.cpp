@@ -14,6 +14,7 @@
 */
 
 #include "IonoModbusRtuSlave.h"
+#include "IonoMetrics.h"
 
 #ifdef IONO_RP
 #define ONE_WIRE_ENABLED 0
@@ -249,7 +250,19 @@ void IonoModbusRtuSlaveClass::onDIChange(uint8_t pin, float value) {
   }
 }
 
+// Counts the frames addressed to this unit and the exceptions returned
 byte IonoModbusRtuSlaveClass::onRequest(byte unitAddr, byte function, word regAddr, word qty, byte *data) {
+  byte respCode = handleRequest(unitAddr, function, regAddr, qty, data);
+  IONO_METRIC_INC(modbusFrames);
+  // Exception codes go up to 0x0B, anything else, as a frame
+  // ignored, is not answered with an error
+  if (respCode >= MB_EX_ILLEGAL_FUNCTION && respCode <= 0x0B) {
+    IONO_METRIC_INC(modbusErrors);
+  }
+  return respCode;
+}
+
+byte IonoModbusRtuSlaveClass::handleRequest(byte unitAddr, byte function, word regAddr, word qty, byte *data) {
   byte respCode;
   if (_customCallback != NULL) {
     respCode = _customCallback(unitAddr, function, regAddr, qty, data);
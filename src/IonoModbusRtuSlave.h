@@ -56,6 +56,7 @@ class IonoModbusRtuSlaveClass {
     static ModbusRtuSlaveClass::Callback *_customCallback;
 
     static byte onRequest(byte unitAddr, byte function, word regAddr, word qty, byte *data);
+    static byte handleRequest(byte unitAddr, byte function, word regAddr, word qty, byte *data);
     static void onDIChange(uint8_t pin, float value);
     static bool checkAddrRange(word regAddr, word qty, word min, word max);
     static uint8_t indexToDO(int i);
@@ -0,0 +1,138 @@
+/*
+  IonoRateLimiter.cpp - Notification rate limiting for Iono Uno/MKR/RP
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include "IonoRateLimiter.h"
+#include "IonoMetrics.h"
+
+IonoRateLimiter::IonoRateLimiter() {
+  _channelItvl = 0;
+  _channelBurst = 1;
+  _transportItvl = 0;
+  _transportBurst = 1;
+  _pending = 0;
+  _nextPin = 0;
+  _transport.tokens = 1;
+  _transport.ts = 0;
+  for (int i = 0; i < IONO_RL_CHANNELS; i++) {
+    _channel[i].tokens = 1;
+    _channel[i].ts = 0;
+  }
+  resetCounters();
+}
+
+// Each channel can notify on average once every interval ms,
+// with up to burst notifications in a row. 0 for no limit
+void IonoRateLimiter::setChannelRate(unsigned long interval, uint8_t burst) {
+  _channelItvl = interval;
+  _channelBurst = burst > 0 ? burst : 1;
+  unsigned long ts = millis();
+  for (int i = 0; i < IONO_RL_CHANNELS; i++) {
+    _channel[i].tokens = _channelBurst;
+    _channel[i].ts = ts;
+  }
+}
+
+// Budget shared by all the channels of the transport
+void IonoRateLimiter::setTransportRate(unsigned long interval, uint8_t burst) {
+  _transportItvl = interval;
+  _transportBurst = burst > 0 ? burst : 1;
+  _transport.tokens = _transportBurst;
+  _transport.ts = millis();
+}
+
+// Returns true if the change can be sent now. Otherwise the value
+// is kept, replacing any previous one of the same channel, and
+// returned by next() once the buckets have refilled
+bool IonoRateLimiter::allow(uint8_t pin, float value) {
+  if (pin >= IONO_RL_CHANNELS) {
+    return true;
+  }
+  if (take(pin)) {
+    _pending &= ~(1UL << pin);
+    return true;
+  }
+  _pending |= 1UL << pin;
+  _value[pin] = value;
+  if (_suppressed[pin] < 0xffff) {
+    _suppressed[pin]++;
+  }
+  _suppressedTotal++;
+  IONO_METRIC_INC(rateLimited);
+  return false;
+}
+
+// Returns a throttled channel that can be sent now, with its
+// latest value, or -1
+int IonoRateLimiter::next(float *value) {
+  if (_pending == 0) {
+    return -1;
+  }
+  // Round-robin, so that a shared budget is not always
+  // spent on the lowest channels
+  for (uint8_t i = 0; i < IONO_RL_CHANNELS; i++) {
+    uint8_t pin = (_nextPin + i) % IONO_RL_CHANNELS;
+    if ((_pending & (1UL << pin)) && take(pin)) {
+      _pending &= ~(1UL << pin);
+      _nextPin = (pin + 1) % IONO_RL_CHANNELS;
+      *value = _value[pin];
+      return pin;
+    }
+  }
+  return -1;
+}
+
+unsigned long IonoRateLimiter::getSuppressed() {
+  return _suppressedTotal;
+}
+
+unsigned int IonoRateLimiter::getSuppressed(uint8_t pin) {
+  return pin < IONO_RL_CHANNELS ? _suppressed[pin] : 0;
+}
+
+void IonoRateLimiter::resetCounters() {
+  for (int i = 0; i < IONO_RL_CHANNELS; i++) {
+    _suppressed[i] = 0;
+  }
+  _suppressedTotal = 0;
+}
+
+void IonoRateLimiter::refill(Bucket *bucket, unsigned long interval, uint8_t burst) {
+  unsigned long ts = millis();
+  if (interval == 0) {
+    bucket->tokens = burst;
+    return;
+  }
+  unsigned long n = (ts - bucket->ts) / interval;
+  if (n > 0) {
+    if (bucket->tokens + n >= burst) {
+      bucket->tokens = burst;
+      bucket->ts = ts;
+    } else {
+      bucket->tokens += n;
+      bucket->ts += n * interval;
+    }
+  }
+}
+
+bool IonoRateLimiter::take(uint8_t pin) {
+  refill(&_channel[pin], _channelItvl, _channelBurst);
+  refill(&_transport, _transportItvl, _transportBurst);
+  if (_channel[pin].tokens == 0 || _transport.tokens == 0) {
+    return false;
+  }
+  _channel[pin].tokens--;
+  _transport.tokens--;
+  return true;
+}
@@ -0,0 +1,67 @@
+/*
+  IonoRateLimiter.h - Notification rate limiting for Iono Uno/MKR/RP
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef IonoRateLimiter_h
+#define IonoRateLimiter_h
+
+#include <Iono.h>
+
+// Channels tracked, DO1..DI6 by default. AO1 is not an input and
+// is never throttled, as any pin from here on. About 12 bytes of
+// RAM per channel on AVR
+#ifndef IONO_RL_CHANNELS
+#define IONO_RL_CHANNELS 20
+#endif
+
+// The throttled channels are kept in a 32-bit mask
+#if IONO_RL_CHANNELS > 32
+#error "IONO_RL_CHANNELS must be 32 or less"
+#endif
+
+class IonoRateLimiter
+{
+  public:
+    IonoRateLimiter();
+    void setChannelRate(unsigned long interval, uint8_t burst);
+    void setTransportRate(unsigned long interval, uint8_t burst);
+    bool allow(uint8_t pin, float value);
+    int next(float *value);
+    unsigned long getSuppressed();
+    unsigned int getSuppressed(uint8_t pin);
+    void resetCounters();
+
+  private:
+    typedef struct Bucket
+    {
+      uint8_t tokens;
+      unsigned long ts;
+    } Bucket;
+    Bucket _channel[IONO_RL_CHANNELS];
+    Bucket _transport;
+    unsigned long _channelItvl;
+    uint8_t _channelBurst;
+    unsigned long _transportItvl;
+    uint8_t _transportBurst;
+    uint32_t _pending;
+    uint8_t _nextPin;
+    float _value[IONO_RL_CHANNELS];
+    unsigned int _suppressed[IONO_RL_CHANNELS];
+    unsigned long _suppressedTotal;
+
+    void refill(Bucket *bucket, unsigned long interval, uint8_t burst);
+    bool take(uint8_t pin);
+};
+
+#endif
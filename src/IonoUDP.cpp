@@ -14,6 +14,13 @@
 */
 
 #include "IonoUDP.h"
+#include "IonoMetrics.h"
+
+static const char keyId[] PROGMEM = "id";
+static const char keyPin[] PROGMEM = "pin";
+static const char keyPr[] PROGMEM = "pr";
+static const char keyVal[] PROGMEM = "val";
+static const char keyChg[] PROGMEM = "chg";
 
 char IonoUDPClass::_pinName[][4] = {
   "DO1",
@@ -40,7 +47,7 @@ char IonoUDPClass::_pinName[][4] = {
 };
 
 IonoUDPClass::IonoUDPClass() {
-  _ipBroadcast = IPAddress(255, 255, 255, 255);
+  _ipNotify = IPAddress(255, 255, 255, 255);
 
   for (int i = 0; i < 20; i++) {
     _lastValue[i] = -99;
@@ -48,12 +55,30 @@ IonoUDPClass::IonoUDPClass() {
     _lastTS[i] = -99;
   }
 
-  _progr = 0;
+  _seq = 0;
   _lastSend = 0;
+  _protocol = IONO_UDP_JSON;
+  _coalescing = false;
+  _changed = 0;
+  _reliable = false;
+  _resync = false;
+  _srtt = 0;
+  _rttvar = 0;
+  _rto = IONO_UDP_RTO_INIT;
+  _txHead = 0;
+  _txCount = 0;
+  _stateGen = 0;
+  _cacheGen = 0;
+  _cacheLen = 0;
+
+  for (int i = 0; i < IONO_UDP_MAX_SUBSCRIBERS; i++) {
+    _subscribers[i].lease = 0;
+  }
 }
 
-void IonoUDPClass::begin(const char *id, EthernetUDP Udp, unsigned int port, unsigned long stableTime, float minVariation) {
+void IonoUDPClass::begin(const char *id, EthernetUDP Udp, unsigned int port, unsigned long stableTime, float minVariation, uint8_t protocol) {
   _id = id;
+  _protocol = protocol;
   _Udp = Udp;
   _port = port;
   _stableTime = stableTime;
@@ -61,9 +86,35 @@ void IonoUDPClass::begin(const char *id, EthernetUDP Udp, unsigned int port, uns
   Iono.setup();
 }
 
+void IonoUDPClass::setCoalescing(bool enabled) {
+  _coalescing = enabled;
+}
+
+// In reliable mode every notification is sent once and repeated
+// only until the receiver acknowledges its sequence number. If one
+// has to be dropped from the full queue before that, all the known
+// values are sent again in a new one
+void IonoUDPClass::setReliable(bool enabled) {
+  _reliable = enabled;
+}
+
+// Notifications go to the group instead of broadcast when there
+// are no subscribers. Call after begin(). Sending needs no join,
+// the command socket keeps listening on the port as before
+void IonoUDPClass::setMulticastGroup(IPAddress group) {
+  _ipNotify = group;
+}
+
+#if IONO_UDP_RATE_LIMIT
+IonoRateLimiter& IonoUDPClass::getRateLimiter() {
+  return _limiter;
+}
+#endif
+
 void IonoUDPClass::process() {
   checkState();
   checkCommands();
+  transmit();
 }
 
 void IonoUDPClass::checkState() {
@@ -91,20 +142,36 @@ void IonoUDPClass::checkState() {
   check(AI3);
   check(AI4);
 
-  unsigned long ts = millis();
-  if (ts - _lastSend > 30000) {
-    for (int i = 0; i < 3; i++) {
-      _Udp.beginPacket(_ipBroadcast, _port);
-      _Udp.write("{\"id\":\"");
-      _Udp.write(_id);
-      _Udp.write("\",\"pr\":");
-      _Udp.write('0' + _progr);
-      _Udp.write("}");
-      _Udp.endPacket();
-      delay(3);
+#if IONO_UDP_RATE_LIMIT
+  // Throttled channels, with their latest value
+  float val;
+  int pin;
+  while ((pin = _limiter.next(&val)) >= 0) {
+    notify(pin, _value[pin]);
+    _lastSend = millis();
+  }
+#endif
+
+  if (_resync) {
+    // A notification was dropped before being acknowledged:
+    // send all the known values again instead
+    for (int pin = 0; pin < 20; pin++) {
+      if (_value[pin] != -99) {
+        _changed |= 1UL << pin;
+      }
     }
+    sendChanges(TX_STATE);
+    // It also covers what it has pushed out of the queue
+    _resync = false;
+  }
 
-    _progr = (_progr + 1) % 10;
+  if (_changed != 0) {
+    sendChanges(TX_CHANGES);
+  }
+
+  unsigned long ts = millis();
+  if (ts - _lastSend > 30000) {
+    enqueue(TX_HEARTBEAT);
     _lastSend = ts;
   }
 }
@@ -123,8 +190,16 @@ void IonoUDPClass::check(int pin) {
       diff = abs(diff);
       if (diff >= _minVariation) {
         _value[pin] = val;
-        send(pin, val);
-        _lastSend = ts;
+        _stateGen++;
+#if IONO_UDP_RATE_LIMIT
+        bool allowed = _limiter.allow(pin, val);
+#else
+        bool allowed = true;
+#endif
+        if (allowed) {
+          notify(pin, val);
+          _lastSend = ts;
+        }
       }
     }
   }
@@ -132,124 +207,651 @@ void IonoUDPClass::check(int pin) {
   _lastValue[pin] = val;
 }
 
-void IonoUDPClass::send(int pin, float val) {
-  char sVal[6];
-  if (_pinName[pin][0] == 'D') {
-    sVal[0] = val == HIGH ? '1' : '0';
-    sVal[1] = '\0';
+void IonoUDPClass::notify(int pin, float val) {
+  if (_coalescing) {
+    _changed |= 1UL << pin;
   } else {
-    ftoa(sVal, val);
-  }
-
-  for (int i = 0; i < 3; i++) {
-    _Udp.beginPacket(_ipBroadcast, _port);
-    _Udp.write("{\"id\":\"");
-    _Udp.write(_id);
-    _Udp.write("\",\"pin\":\"");
-    _Udp.write(_pinName[pin]);
-    _Udp.write("\",\"pr\":");
-    _Udp.write('0' + _progr);
-    _Udp.write(",\"val\":");
-    _Udp.write(sVal);
-    _Udp.write("}");
-    _Udp.endPacket();
-    delay(3);
+    send(pin, val);
   }
+}
 
-  _progr = (_progr + 1) % 10;
+void IonoUDPClass::send(int pin, float val) {
+  TxPacket *packet = enqueue(TX_CHANGE);
+  packet->mask = 1UL << pin;
+  packet->value[pin] = (int16_t) (val * 100 + 0.5);
 }
 
-void IonoUDPClass::ftoa(char *sVal, float fVal) {
-  fVal += 0.005;
+// Gathers all the changes of one checkState() pass in as few
+// datagrams as possible, each within IONO_UDP_MAX_DATAGRAM bytes
+void IonoUDPClass::sendChanges(uint8_t type) {
+  char sVal[14];
+  // {"id":"<id>","pr":<seq>,"chg":[]}, the sequence number is sent
+  // as an int32 in reliable mode, up to 11 chars
+  int headerLen = 24 + strlen(_id) + (_reliable ? 11 : 1);
+  int len = IONO_UDP_MAX_DATAGRAM;
+  TxPacket *packet = NULL;
+
+  for (int pin = 0; pin < 20; pin++) {
+    if (_changed & (1UL << pin)) {
+      int16_t value = (int16_t) (_value[pin] * 100 + 0.5);
+      int entryLen = 10 + formatValue(sVal, pin, value); // ,["XXX",<val>]
+      if (packet == NULL || len + entryLen > IONO_UDP_MAX_DATAGRAM) {
+        packet = enqueue(type);
+        len = headerLen;
+      } else {
+        IONO_METRIC_INC(coalesced);
+      }
+      packet->mask |= 1UL << pin;
+      packet->value[pin] = value;
+      len += entryLen;
+    }
+  }
 
-  int dVal = fVal;
-  int dec = (int)(fVal * 100) % 100;
+  _changed = 0;
+}
 
-  int i = 0;
-  int d = dVal / 10;
-  if (d != 0) {
-    sVal[i++] = d + '0';
+IonoUDPClass::TxPacket *IonoUDPClass::enqueue(uint8_t type) {
+  if (_txCount == IONO_UDP_TX_QUEUE_SIZE) {
+    // Send what is due first, packets never sent included, so
+    // that only repetitions are lost
+    transmit();
   }
-  sVal[i++] = (dVal % 10) + '0';
-  sVal[i++] = '.';
-  sVal[i++] = (dec / 10) + '0';
-  sVal[i++] = (dec % 10) + '0';
-  sVal[i] = '\0';
+  if (_txCount == IONO_UDP_TX_QUEUE_SIZE) {
+    // Still full: drop the remaining repetitions of the oldest packet
+    TxPacket *oldest = &_txQueue[_txHead];
+    if (_reliable && oldest->type != TX_HEARTBEAT && oldest->repeats > 0) {
+      // Not needed if a newer state is still queued
+      bool covered = false;
+      for (uint8_t i = 1; i < _txCount; i++) {
+        if (_txQueue[(_txHead + i) % IONO_UDP_TX_QUEUE_SIZE].type == TX_STATE) {
+          covered = true;
+        }
+      }
+      if (!covered) {
+        _resync = true;
+      }
+    }
+    _txHead = (_txHead + 1) % IONO_UDP_TX_QUEUE_SIZE;
+    _txCount--;
+    IONO_METRIC_INC(dropped);
+  }
+
+  TxPacket *packet = &_txQueue[(_txHead + _txCount) % IONO_UDP_TX_QUEUE_SIZE];
+  packet->type = type;
+  packet->retries = 0;
+  packet->pending = 0;
+  packet->mask = 0;
+  packet->nextTS = millis();
+  _txCount++;
+
+  if (!_reliable) {
+    packet->repeats = IONO_UDP_REPEATS;
+    packet->seq = ++_seq;
+  } else if (type == TX_HEARTBEAT) {
+    // Not acknowledged, carries the last sequence number
+    // so that the receiver can detect a lost tail
+    packet->repeats = 1;
+    packet->seq = _seq;
+  } else {
+    packet->repeats = IONO_UDP_MAX_RETRIES + 1;
+    packet->seq = ++_seq;
+  }
+  return packet;
 }
 
-void IonoUDPClass::checkCommands() {
-  int packetSize = _Udp.parsePacket();
-  if(packetSize) {
-    for (int i = 0; i < COMMAND_MAX_SIZE; i++) {
-      _command[i] = '\0';
-    }
-    _Udp.read(_command, COMMAND_MAX_SIZE);
-    if (strcmp(_command, "state") == 0) {
-      _Udp.beginPacket(_Udp.remoteIP(), _Udp.remotePort());
-      _Udp.write("{");
-      _Udp.write("\"id\":\"");
-      _Udp.write(_id);
-      _Udp.write("\"");
-      char sVal[6];
-      for (int i = 0; i < 20; i++) {
-        _Udp.write(",");
-        _Udp.write("\"");
-        _Udp.write(_pinName[i]);
-        _Udp.write("\":");
-        if (_pinName[i][0] == 'D') {
-          _Udp.write(_value[i] == HIGH ? "1" : "0");
-        } else {
-          ftoa(sVal, _value[i]);
-          _Udp.write(sVal);
+// Sends the packets due without waiting between repetitions
+void IonoUDPClass::transmit() {
+  unsigned long ts = millis();
+  for (uint8_t i = 0; i < _txCount; i++) {
+    TxPacket *packet = &_txQueue[(_txHead + i) % IONO_UDP_TX_QUEUE_SIZE];
+    if (packet->repeats > 0 && (long) (ts - packet->nextTS) >= 0) {
+      if (_reliable && packet->pending != 0) {
+        // Retransmit only to the subscribers still active
+        packet->pending &= activeSubscribers();
+        if (packet->pending == 0) {
+          packet->repeats = 0;
+          continue;
         }
       }
-      _Udp.write("}");
-      _Udp.endPacket();
+      writePacket(packet);
+      packet->repeats--;
+      if (!_reliable) {
+        packet->nextTS = ts + IONO_UDP_REPEAT_ITVL;
+      } else {
+        if (packet->retries == 0) {
+          packet->sentTS = ts;
+        }
+        // Exponential backoff on each retransmission
+        unsigned long rto = _rto << packet->retries;
+        packet->nextTS = ts + (rto < IONO_UDP_RTO_MAX ? rto : IONO_UDP_RTO_MAX);
+        packet->retries++;
+      }
+    }
+  }
+
+  while (_txCount > 0 && _txQueue[_txHead].repeats == 0) {
+    _txQueue[_txHead].type = TX_NONE;
+    _txHead = (_txHead + 1) % IONO_UDP_TX_QUEUE_SIZE;
+    _txCount--;
+  }
+}
+
+// Packets sent to subscribers are complete when all of them
+// have acknowledged, broadcast ones on the first ack
+void IonoUDPClass::acknowledge(uint32_t seq, IPAddress ip, uint16_t port) {
+  if (!_reliable) {
+    return;
+  }
+  for (uint8_t i = 0; i < _txCount; i++) {
+    TxPacket *packet = &_txQueue[(_txHead + i) % IONO_UDP_TX_QUEUE_SIZE];
+    if (packet->seq == seq && packet->type != TX_HEARTBEAT && packet->retries > 0 && packet->repeats > 0) {
+      if (packet->pending != 0) {
+        int sub = findSubscriber(ip, port);
+        if (sub < 0 || !(packet->pending & (1 << sub))) {
+          return;
+        }
+        packet->pending &= ~(1 << sub);
+      }
+      if (packet->retries == 1) {
+        // Karn's algorithm: only sample packets sent once
+        updateRto(millis() - packet->sentTS);
+      }
+      if (packet->pending == 0) {
+        packet->repeats = 0;
+      }
       return;
+    }
+  }
+}
+
+// Smoothed round-trip time and retransmission timeout as in RFC 6298
+void IonoUDPClass::updateRto(unsigned long rtt) {
+  if (_srtt == 0 && _rttvar == 0) {
+    _srtt = rtt;
+    _rttvar = rtt / 2;
+  } else {
+    unsigned long delta = _srtt > rtt ? _srtt - rtt : rtt - _srtt;
+    _rttvar = (3 * _rttvar + delta) / 4;
+    _srtt = (7 * _srtt + rtt) / 8;
+  }
+  _rto = _srtt + 4 * _rttvar;
+  if (_rto < IONO_UDP_RTO_MIN) {
+    _rto = IONO_UDP_RTO_MIN;
+  } else if (_rto > IONO_UDP_RTO_MAX) {
+    _rto = IONO_UDP_RTO_MAX;
+  }
+}
 
-    } else if (strlen(_command) > 4 && _command[3] == '=') {
-      char pn[4];
-      for (int i = 0; i < 3; i++) {
-        pn[i] = _command[i];
+void IonoUDPClass::writeSeq(IonoJsonWriter &json, uint32_t seq) {
+  json.keyP(keyPr);
+  json.value(_reliable ? (int32_t) seq : (int32_t) (seq % 10));
+}
+
+// Sends to each subscriber, or to the broadcast address or
+// multicast group when there are none. Reliable retransmissions
+// only go to the subscribers that have not acknowledged yet
+void IonoUDPClass::writePacket(TxPacket *packet) {
+  if (!_reliable || packet->retries == 0) {
+    packet->pending = activeSubscribers();
+  }
+
+  for (int i = 0; i < IONO_UDP_MAX_SUBSCRIBERS; i++) {
+    if (packet->pending & (1 << i)) {
+      _Udp.beginPacket(_subscribers[i].ip, _subscribers[i].port);
+      if (_protocol == IONO_UDP_BINARY) {
+        writeBinaryPayload(packet);
+      } else {
+        writeJsonPayload(packet);
       }
-      pn[3] = '\0';
+      _Udp.endPacket();
+      IONO_METRIC_INC(notifications[IONO_METRIC_UDP]);
+    }
+  }
 
-      int pin = -1;
-      for (int i = 0; i < 21; i++) {
-        if (strcmp(_pinName[i], pn) == 0) {
-          pin = i;
-          break;
+  if (packet->pending == 0) {
+    _Udp.beginPacket(_ipNotify, _port);
+    if (_protocol == IONO_UDP_BINARY) {
+      writeBinaryPayload(packet);
+    } else {
+      writeJsonPayload(packet);
+    }
+    _Udp.endPacket();
+    IONO_METRIC_INC(notifications[IONO_METRIC_UDP]);
+  }
+}
+
+// Written through a small buffer, flushed to the datagram when full
+void IonoUDPClass::writeJsonPayload(TxPacket *packet) {
+  char buff[64];
+  IonoJsonWriter json(buff, sizeof(buff), &_Udp);
+
+  json.beginObject();
+  json.keyP(keyId);
+  json.string(_id);
+  if (packet->type == TX_CHANGE) {
+    int pin = 0;
+    while (!(packet->mask & (1UL << pin))) {
+      pin++;
+    }
+    json.keyP(keyPin);
+    json.string(_pinName[pin]);
+    writeSeq(json, packet->seq);
+    json.keyP(keyVal);
+    writeValue(json, pin, packet->value[pin]);
+  } else {
+    writeSeq(json, packet->seq);
+    if (packet->type == TX_CHANGES || packet->type == TX_STATE) {
+      json.keyP(keyChg);
+      json.beginArray();
+      for (int pin = 0; pin < 20; pin++) {
+        if (packet->mask & (1UL << pin)) {
+          json.beginArray();
+          json.string(_pinName[pin]);
+          writeValue(json, pin, packet->value[pin]);
+          json.endArray();
         }
       }
+      json.endArray();
+    }
+  }
+  json.endObject();
+  json.flush();
+}
 
-      if (pin != -1) {
-        if (pn[0] == 'D') {
-          if (_command[4] == 'f') {
-            Iono.flip(pin);
-          } else {
-            Iono.write(pin, _command[4] == '1' ? HIGH : LOW);
-          }
+/*
+ * Binary protocol, all integers are big-endian:
+ *
+ *   notification: type(1) seq(4) idLen(1) id(idLen) [channel(1) value(2)]...
+ *   commands:     [BIN_CMD_STATE] | [BIN_CMD_SET channel(1) value(2)] |
+ *                 [BIN_CMD_FLIP channel(1)] | [BIN_CMD_ACK seq(4)] |
+ *                 [BIN_CMD_RESYNC] | [BIN_CMD_SUBSCRIBE lease(2)],
+ *                 several per datagram, lease in seconds, 0 to unsubscribe
+ *   result:       BIN_RESULT status(1), 0 = ok, not sent when the
+ *                 datagram only contains state, ack or resync commands
+ *
+ * Channels are numbered as DO1..AO1. Digital values are 0 or 1,
+ * analog values are fixed-point hundredths of V or mA. Only DO1..DO6
+ * and AO1 can be set, DO1..DO6 flipped. A datagram with any wrong
+ * command is rejected as a whole.
+ */
+void IonoUDPClass::writeBinaryPayload(TxPacket *packet) {
+  writeBinaryHeader(packet->type == TX_HEARTBEAT ? BIN_HEARTBEAT : BIN_CHANGES, packet->seq);
+  for (int pin = 0; pin < 20; pin++) {
+    if (packet->mask & (1UL << pin)) {
+      writeBinaryValue(pin, packet->value[pin]);
+    }
+  }
+}
 
-        } else {
-          char val[6];
-          for (int i = 0; i < 5; i++) {
-            val[i] = _command[i + 4];
+void IonoUDPClass::writeBinaryHeader(uint8_t type, uint32_t seq) {
+  uint8_t idLen = strlen(_id);
+  uint8_t header[6] = {type, (uint8_t) (seq >> 24), (uint8_t) (seq >> 16), (uint8_t) (seq >> 8), (uint8_t) seq, idLen};
+  _Udp.write(header, 6);
+  _Udp.write((const uint8_t *) _id, idLen);
+}
+
+void IonoUDPClass::writeBinaryValue(int pin, int16_t value) {
+  if (_pinName[pin][0] == 'D') {
+    value = value >= 100 ? 1 : 0;
+  }
+  uint8_t record[3] = {(uint8_t) pin, (uint8_t) (value >> 8), (uint8_t) value};
+  _Udp.write(record, 3);
+}
+
+void IonoUDPClass::writeValue(IonoJsonWriter &json, int pin, int16_t value) {
+  if (_pinName[pin][0] == 'D') {
+    json.value(value >= 100 ? 1 : 0);
+  } else {
+    json.fixed(value, 2);
+  }
+}
+
+// Formats a value in hundredths, returns the string length.
+// sVal must hold 14 chars, as for IonoJsonWriter::fixed()
+uint8_t IonoUDPClass::formatValue(char *sVal, int pin, int16_t value) {
+  if (_pinName[pin][0] == 'D') {
+    sVal[0] = value >= 100 ? '1' : '0';
+    sVal[1] = '\0';
+    return 1;
+  }
+  return IonoJsonWriter::formatFixed(sVal, value, 2);
+}
+
+// Handles the datagrams queued since the last call, up to
+// IONO_UDP_RX_BUDGET per call
+void IonoUDPClass::checkCommands() {
+  for (int n = 0; n < IONO_UDP_RX_BUDGET; n++) {
+    int packetSize = _Udp.parsePacket();
+    if (!packetSize) {
+      return;
+    }
+    if (_protocol == IONO_UDP_BINARY) {
+      checkBinaryCommands(packetSize);
+    } else {
+      checkTextCommands(packetSize);
+    }
+  }
+}
+
+void IonoUDPClass::checkTextCommands(int size) {
+  for (int i = 0; i < COMMAND_MAX_SIZE; i++) {
+    _command[i] = '\0';
+  }
+  _Udp.read(_command, COMMAND_MAX_SIZE - 1);
+  if (size > COMMAND_MAX_SIZE - 1) {
+    reply("error");
+    return;
+  }
+
+  if (strcmp(_command, "state") == 0 || strcmp(_command, "resync") == 0) {
+    replyState();
+
+  } else if (strncmp(_command, "ack=", 4) == 0) {
+    // ack=<seq>[,<seq>...], no reply
+    char *p = _command + 3;
+    do {
+      acknowledge(strtoul(p + 1, &p, 10), _Udp.remoteIP(), _Udp.remotePort());
+    } while (*p == ',');
+
+  } else if (strncmp(_command, "sub=", 4) == 0) {
+    // sub=<lease seconds>, renewed by sending it again
+    reply(subscribe(_Udp.remoteIP(), _Udp.remotePort(), strtoul(_command + 4, NULL, 10)) ? "ok" : "error");
+
+  } else if (strcmp(_command, "unsub") == 0) {
+    subscribe(_Udp.remoteIP(), _Udp.remotePort(), 0);
+    reply("ok");
+
+  } else {
+    reply(applyCommands() ? "ok" : "error");
+  }
+}
+
+// Runs a batch of assignments separated by ';' or newlines,
+// e.g. "DO1=1;DO2=f;AO1=5.00". Nothing is applied unless all
+// of them are valid
+bool IonoUDPClass::applyCommands() {
+  for (int pass = 0; pass < 2; pass++) {
+    int count = 0;
+    char *cmd = _command;
+    while (*cmd != '\0') {
+      char *end = cmd;
+      while (*end != '\0' && *end != ';' && *end != '\n') {
+        end++;
+      }
+
+      if (end > cmd) {
+        int pin = (end - cmd > 4 && cmd[3] == '=') ? pinIndex(cmd) : -1;
+        if (pin < 0 || !isOutput(pin)) {
+          return false;
+        }
+        if (pass == 1) {
+          if (cmd[0] == 'D') {
+            if (cmd[4] == 'f') {
+              Iono.flip(pin);
+            } else {
+              Iono.write(pin, cmd[4] == '1' ? HIGH : LOW);
+            }
+          } else {
+            Iono.write(pin, atof(cmd + 4));
           }
-          val[5] = '\0';
-          Iono.write(pin, atof(val));
         }
+        count++;
       }
 
-      _Udp.beginPacket(_Udp.remoteIP(), _Udp.remotePort());
-      _Udp.write("ok");
-      _Udp.endPacket();
-      return;
+      cmd = *end != '\0' ? end + 1 : end;
     }
 
+    if (count == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Maps a channel name, e.g. "DI3", to its index in _pinName
+// Only the relays and the analog output can be set
+bool IonoUDPClass::isOutput(int pin) {
+  return (pin >= DO1 && pin <= DO6) || pin == AO1;
+}
+
+int IonoUDPClass::pinIndex(const char *name) {
+  static const uint8_t di[] = {DI1, DI2, DI3, DI4, DI5, DI6};
+  static const uint8_t av[] = {AV1, AV2, AV3, AV4};
+  static const uint8_t ai[] = {AI1, AI2, AI3, AI4};
+
+  int n = name[2] - '1';
+  if (name[0] == 'D' && name[1] == 'O' && n >= 0 && n < 6) {
+    return DO1 + n;
+  } else if (name[0] == 'D' && name[1] == 'I' && n >= 0 && n < 6) {
+    return di[n];
+  } else if (name[0] == 'A' && name[1] == 'V' && n >= 0 && n < 4) {
+    return av[n];
+  } else if (name[0] == 'A' && name[1] == 'I' && n >= 0 && n < 4) {
+    return ai[n];
+  } else if (name[0] == 'A' && name[1] == 'O' && n == 0) {
+    return AO1;
+  }
+  return -1;
+}
+
+void IonoUDPClass::checkBinaryCommands(int size) {
+  uint8_t *cmd = (uint8_t *) _command;
+  int len = _Udp.read(cmd, COMMAND_MAX_SIZE);
+  bool ok = len == size;
+  bool result = false;
+
+  // The first pass only validates, so that a wrong command
+  // anywhere in the datagram leaves all the outputs unchanged.
+  // Anything that can fail is checked there, the second cannot
+  for (int pass = 0; ok && pass < 2; pass++) {
+    bool apply = pass == 1;
+    for (int i = 0; ok && i < len;) {
+      switch (cmd[i]) {
+        case BIN_CMD_STATE:
+        case BIN_CMD_RESYNC:
+          if (apply) {
+            replyState();
+          }
+          i++;
+          break;
+
+        case BIN_CMD_SET:
+          if (i + 4 > len || !isOutput(cmd[i + 1])) {
+            ok = false;
+            break;
+          }
+          if (apply) {
+            if (cmd[i + 1] != AO1) {
+              Iono.write(cmd[i + 1], cmd[i + 3] ? HIGH : LOW);
+            } else {
+              Iono.write(cmd[i + 1], (int16_t) ((cmd[i + 2] << 8) | cmd[i + 3]) / 100.0);
+            }
+            result = true;
+          }
+          i += 4;
+          break;
+
+        case BIN_CMD_FLIP:
+          if (i + 2 > len || !isOutput(cmd[i + 1]) || cmd[i + 1] == AO1) {
+            ok = false;
+            break;
+          }
+          if (apply) {
+            Iono.flip(cmd[i + 1]);
+            result = true;
+          }
+          i += 2;
+          break;
+
+        case BIN_CMD_ACK:
+          if (i + 5 > len) {
+            ok = false;
+            break;
+          }
+          if (apply) {
+            acknowledge(((uint32_t) cmd[i + 1] << 24) | ((uint32_t) cmd[i + 2] << 16) | ((uint32_t) cmd[i + 3] << 8) | cmd[i + 4],
+                _Udp.remoteIP(), _Udp.remotePort());
+          }
+          i += 5;
+          break;
+
+        case BIN_CMD_SUBSCRIBE:
+          // All from the same sender, one entry is enough for all
+          if (i + 3 > len || (((cmd[i + 1] << 8) | cmd[i + 2]) != 0
+              && subscriberSlot(_Udp.remoteIP(), _Udp.remotePort()) < 0)) {
+            ok = false;
+            break;
+          }
+          if (apply) {
+            subscribe(_Udp.remoteIP(), _Udp.remotePort(), (cmd[i + 1] << 8) | cmd[i + 2]);
+            result = true;
+          }
+          i += 3;
+          break;
+
+        default:
+          ok = false;
+      }
+    }
+  }
+
+  if (result || !ok) {
+    uint8_t result[2] = {BIN_RESULT, (uint8_t) (ok ? 0 : 1)};
     _Udp.beginPacket(_Udp.remoteIP(), _Udp.remotePort());
-    _Udp.write("error");
+    _Udp.write(result, 2);
     _Udp.endPacket();
   }
 }
 
+void IonoUDPClass::reply(const char *msg) {
+  _Udp.beginPacket(_Udp.remoteIP(), _Udp.remotePort());
+  _Udp.write(msg);
+  _Udp.endPacket();
+}
+
+// The channel values are serialized once per change and the
+// cached bytes are sent as they are to every poll. In reliable
+// mode the state includes the last sequence number, the receiver
+// resyncs on it after detecting a gap
+void IonoUDPClass::replyState() {
+  if (_cacheLen == 0 || _cacheGen != _stateGen) {
+    updateStateCache();
+  }
+
+  _Udp.beginPacket(_Udp.remoteIP(), _Udp.remotePort());
+  if (_protocol == IONO_UDP_BINARY) {
+    writeBinaryHeader(BIN_STATE, _seq);
+  } else {
+    char buff[32];
+    IonoJsonWriter json(buff, sizeof(buff), &_Udp);
+    json.beginObject();
+    json.keyP(keyId);
+    json.string(_id);
+    if (_reliable) {
+      writeSeq(json, _seq);
+    }
+    if (_cacheLen == 0) {
+      writeJsonState(json);
+    }
+    json.flush();
+  }
+  _Udp.write((const uint8_t *) _stateCache, _cacheLen);
+  _Udp.endPacket();
+}
+
+void IonoUDPClass::writeJsonState(IonoJsonWriter &json) {
+  for (int pin = 0; pin < 20; pin++) {
+    json.key(_pinName[pin]);
+    writeValue(json, pin, (int16_t) (_value[pin] * 100 + 0.5));
+  }
+  json.endObject();
+}
+
+void IonoUDPClass::updateStateCache() {
+  uint16_t len = 0;
+  if (_protocol == IONO_UDP_BINARY) {
+    for (int pin = 0; pin < 20; pin++) {
+      int16_t value = (int16_t) (_value[pin] * 100 + 0.5);
+      if (_pinName[pin][0] == 'D') {
+        value = value >= 100 ? 1 : 0;
+      }
+      _stateCache[len++] = pin;
+      _stateCache[len++] = value >> 8;
+      _stateCache[len++] = value;
+    }
+  } else {
+    // Continues the object opened by replyState()
+    IonoJsonWriter json(_stateCache, IONO_UDP_STATE_SIZE);
+    json.raw(",");
+    writeJsonState(json);
+    // Never serve a truncated state, replyState() writes it directly
+    len = json.overflow() ? 0 : json.length();
+  }
+  _cacheLen = len;
+  _cacheGen = _stateGen;
+}
+
+// Adds, renews or, with lease 0, removes a subscriber.
+// Returns false if the table is full
+bool IonoUDPClass::subscribe(IPAddress ip, uint16_t port, unsigned long lease) {
+  if (lease > IONO_UDP_MAX_LEASE) {
+    lease = IONO_UDP_MAX_LEASE;
+  }
+  int sub = findSubscriber(ip, port);
+  if (sub < 0) {
+    if (lease == 0) {
+      return true;
+    }
+    sub = subscriberSlot(ip, port);
+    if (sub < 0) {
+      return false;
+    }
+    _subscribers[sub].ip = ip;
+    _subscribers[sub].port = port;
+  }
+  _subscribers[sub].ts = millis();
+  _subscribers[sub].lease = lease * 1000;
+  return true;
+}
+
+// The entry of the given subscriber or a free one for it,
+// -1 if the table is full
+int IonoUDPClass::subscriberSlot(IPAddress ip, uint16_t port) {
+  int sub = findSubscriber(ip, port);
+  if (sub < 0) {
+    activeSubscribers();
+    for (int i = 0; i < IONO_UDP_MAX_SUBSCRIBERS; i++) {
+      if (_subscribers[i].lease == 0) {
+        return i;
+      }
+    }
+  }
+  return sub;
+}
+
+int IonoUDPClass::findSubscriber(IPAddress ip, uint16_t port) {
+  for (int i = 0; i < IONO_UDP_MAX_SUBSCRIBERS; i++) {
+    if (_subscribers[i].lease != 0 && _subscribers[i].ip == ip && _subscribers[i].port == port) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Frees the expired entries, returns the mask of the active ones
+uint8_t IonoUDPClass::activeSubscribers() {
+  unsigned long ts = millis();
+  uint8_t mask = 0;
+  for (int i = 0; i < IONO_UDP_MAX_SUBSCRIBERS; i++) {
+    if (_subscribers[i].lease != 0) {
+      if (ts - _subscribers[i].ts >= _subscribers[i].lease) {
+        _subscribers[i].lease = 0;
+      } else {
+        mask |= 1 << i;
+      }
+    }
+  }
+  return mask;
+}
+
 IonoUDPClass IonoUDP;
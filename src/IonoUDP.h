@@ -19,24 +19,111 @@
 #include <SPI.h>
 #include <Ethernet.h>
 #include <Iono.h>
+#include "IonoRateLimiter.h"
+#include "IonoJson.h"
 
-#define COMMAND_MAX_SIZE 10
+#ifndef COMMAND_MAX_SIZE
+#ifdef __AVR__
+#define COMMAND_MAX_SIZE 64
+#else
+#define COMMAND_MAX_SIZE 160
+#endif
+#endif
+
+#ifndef IONO_UDP_RX_BUDGET
+#ifdef __AVR__
+#define IONO_UDP_RX_BUDGET 2
+#else
+#define IONO_UDP_RX_BUDGET 8
+#endif
+#endif
+
+#ifndef IONO_UDP_TX_QUEUE_SIZE
+#ifdef __AVR__
+#define IONO_UDP_TX_QUEUE_SIZE 4
+#else
+#define IONO_UDP_TX_QUEUE_SIZE 16
+#endif
+#endif
+
+// At most 8, tracked in a bit mask
+#ifndef IONO_UDP_MAX_SUBSCRIBERS
+#ifdef __AVR__
+#define IONO_UDP_MAX_SUBSCRIBERS 2
+#else
+#define IONO_UDP_MAX_SUBSCRIBERS 8
+#endif
+#endif
+
+// Rate limiting of the notifications, see getRateLimiter(). Its
+// buckets take about 245 bytes of RAM, so it is left out on AVR
+#ifndef IONO_UDP_RATE_LIMIT
+#ifdef __AVR__
+#define IONO_UDP_RATE_LIMIT 0
+#else
+#define IONO_UDP_RATE_LIMIT 1
+#endif
+#endif
+
+#ifndef IONO_UDP_MAX_DATAGRAM
+#define IONO_UDP_MAX_DATAGRAM 512
+#endif
+
+// ,"XXX":1 for 12 digital and ,"XXX":-327.68 at most for 8 analog
+// channels, then the closing brace
+#define IONO_UDP_STATE_SIZE 210
+
+#define IONO_UDP_REPEATS 3
+#define IONO_UDP_REPEAT_ITVL 3
+
+#define IONO_UDP_MAX_RETRIES 5
+#define IONO_UDP_RTO_INIT 200
+#define IONO_UDP_RTO_MIN 20
+#define IONO_UDP_RTO_MAX 5000
+
+#define IONO_UDP_MAX_LEASE 3600
+
+#define IONO_UDP_JSON 0
+#define IONO_UDP_BINARY 1
+
+#define BIN_HEARTBEAT 0x01
+#define BIN_CHANGES 0x02
+#define BIN_STATE 0x03
+#define BIN_RESULT 0x04
+#define BIN_CMD_STATE 0x10
+#define BIN_CMD_SET 0x11
+#define BIN_CMD_FLIP 0x12
+#define BIN_CMD_ACK 0x13
+#define BIN_CMD_RESYNC 0x14
+#define BIN_CMD_SUBSCRIBE 0x15
+
+#define TX_NONE 0
+#define TX_HEARTBEAT 1
+#define TX_CHANGE 2
+#define TX_CHANGES 3
+#define TX_STATE 4
 
 class IonoUDPClass
 {
   public:
     IonoUDPClass();
-    void begin(const char *id, EthernetUDP Udp, unsigned int port, unsigned long stableTime, float minVariation);
+    void begin(const char *id, EthernetUDP Udp, unsigned int port, unsigned long stableTime, float minVariation, uint8_t protocol = IONO_UDP_JSON);
+    void setCoalescing(bool enabled);
+    void setReliable(bool enabled);
+    void setMulticastGroup(IPAddress group);
     void process();
+#if IONO_UDP_RATE_LIMIT
+    IonoRateLimiter& getRateLimiter();
+#endif
 
   private:
     static char _pinName[][4];
 
-    IPAddress _ipBroadcast;
+    IPAddress _ipNotify;
     float _lastValue[20];
     float _value[20];
     unsigned long _lastTS[20];
-    char _progr;
+    uint32_t _seq;
     const char *_id;
     unsigned int _port;
     EthernetUDP _Udp;
@@ -44,12 +131,78 @@ class IonoUDPClass
     unsigned long _stableTime;
     float _minVariation;
     unsigned long _lastSend;
+    uint8_t _protocol;
+    bool _coalescing;
+    uint32_t _changed;
+#if IONO_UDP_RATE_LIMIT
+    IonoRateLimiter _limiter;
+#endif
+    bool _reliable;
+    bool _resync;
+    unsigned long _srtt;
+    unsigned long _rttvar;
+    unsigned long _rto;
+
+    typedef struct TxPacket
+    {
+      uint8_t type;
+      uint8_t repeats;
+      uint8_t retries;
+      uint8_t pending;
+      uint32_t seq;
+      uint32_t mask;
+      int16_t value[20];
+      unsigned long sentTS;
+      unsigned long nextTS;
+    } TxPacket;
+    TxPacket _txQueue[IONO_UDP_TX_QUEUE_SIZE];
+    uint8_t _txHead;
+    uint8_t _txCount;
+    char _stateCache[IONO_UDP_STATE_SIZE];
+    uint16_t _cacheLen;
+    uint32_t _stateGen;
+    uint32_t _cacheGen;
+
+    typedef struct Subscriber
+    {
+      IPAddress ip;
+      uint16_t port;
+      unsigned long ts;
+      unsigned long lease;
+    } Subscriber;
+    Subscriber _subscribers[IONO_UDP_MAX_SUBSCRIBERS];
 
     void checkState();
     void check(int pin);
+    void notify(int pin, float val);
     void send(int pin, float val);
-    void ftoa(char *sVal, float fVal);
+    void sendChanges(uint8_t type);
+    TxPacket *enqueue(uint8_t type);
+    void transmit();
+    void acknowledge(uint32_t seq, IPAddress ip, uint16_t port);
+    void updateRto(unsigned long rtt);
+    void writeSeq(IonoJsonWriter &json, uint32_t seq);
+    void writePacket(TxPacket *packet);
+    void writeJsonPayload(TxPacket *packet);
+    void writeBinaryPayload(TxPacket *packet);
+    void writeBinaryHeader(uint8_t type, uint32_t seq);
+    void writeBinaryValue(int pin, int16_t value);
+    void writeValue(IonoJsonWriter &json, int pin, int16_t value);
+    uint8_t formatValue(char *sVal, int pin, int16_t value);
     void checkCommands();
+    void checkTextCommands(int size);
+    void checkBinaryCommands(int size);
+    bool applyCommands();
+    int pinIndex(const char *name);
+    bool isOutput(int pin);
+    void reply(const char *msg);
+    void replyState();
+    void writeJsonState(IonoJsonWriter &json);
+    void updateStateCache();
+    bool subscribe(IPAddress ip, uint16_t port, unsigned long lease);
+    int findSubscriber(IPAddress ip, uint16_t port);
+    int subscriberSlot(IPAddress ip, uint16_t port);
+    uint8_t activeSubscribers();
 };
 
 extern IonoUDPClass IonoUDP;
@@ -0,0 +1,314 @@
+/*
+  IonoWatchdog.cpp - Task supervisor and hardware watchdog for Iono Uno/MKR/RP
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#include "IonoWatchdog.h"
+
+#if defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_MEGAAVR)
+#include <avr/wdt.h>
+#include <avr/interrupt.h>
+#elif defined(ARDUINO_ARCH_RP2040)
+#include <hardware/watchdog.h>
+#include <pico/time.h>
+#endif
+
+#if IONO_WDT_ISR && defined(WDTCSR) && defined(WDIE)
+#define IONO_WDT_EARLY_WARNING
+#endif
+
+#ifdef ARDUINO_ARCH_RP2040
+#define IONO_NOINIT __attribute__((section(".uninitialized_data.iono_wdt")))
+#else
+#define IONO_NOINIT __attribute__((section(".noinit")))
+#endif
+
+#define OVERRUN_MAGIC 0x494f5744
+
+typedef struct OverrunRecord
+{
+  uint32_t magic;
+  char name[IONO_WDT_NAME_SIZE];
+} OverrunRecord;
+
+// Not cleared at startup, survives the watchdog reset
+static volatile OverrunRecord overrunRecord IONO_NOINIT;
+
+#if defined(MCUSR) && defined(WDRF)
+// After a watchdog reset WDRF keeps the watchdog on with the shortest
+// timeout, clear it before the sketch starts or the board keeps resetting
+static void wdtInit() __attribute__((naked, used, section(".init3")));
+
+static void wdtInit() {
+  MCUSR &= ~(1 << WDRF);
+  wdt_disable();
+}
+#endif
+
+#ifdef ARDUINO_ARCH_RP2040
+static repeating_timer_t wdtTimer;
+
+static bool wdtTimerCallback(repeating_timer_t *rt) {
+  IonoWatchdog.earlyWarning();
+  return true;
+}
+#endif
+
+IonoWatchdogClass::IonoWatchdogClass() {
+  _taskCount = 0;
+  _enabled = false;
+  _clearItvl = IONO_WDT_CLEAR_ITVL;
+  _lastOverrun[0] = '\0';
+
+  if (overrunRecord.magic == OVERRUN_MAGIC) {
+    for (int i = 0; i < IONO_WDT_NAME_SIZE; i++) {
+      _lastOverrun[i] = overrunRecord.name[i];
+    }
+    _lastOverrun[IONO_WDT_NAME_SIZE - 1] = '\0';
+  }
+  overrunRecord.magic = 0;
+}
+
+void IonoWatchdogClass::begin(unsigned long timeout) {
+  unsigned long ts = millis();
+  for (int i = 0; i < _taskCount; i++) {
+    _tasks[i].lastTS = ts;
+  }
+#if defined(MCUSR) && defined(WDRF)
+  MCUSR &= ~(1 << WDRF);
+#endif
+  hwBegin(timeout);
+  _enabled = true;
+  _clearTS = ts;
+  // Fed at least 4 times per timeout, so that the early warning,
+  // at half of it or later, comes only when process() is stuck
+  _clearItvl = timeout / 4 < IONO_WDT_CLEAR_ITVL ? timeout / 4 : IONO_WDT_CLEAR_ITVL;
+}
+
+void IonoWatchdogClass::disable() {
+  hwDisable();
+  _enabled = false;
+}
+
+int IonoWatchdogClass::addTask(const char *name, unsigned long deadline) {
+  if (_taskCount >= IONO_WDT_MAX_TASKS) {
+    return -1;
+  }
+  _tasks[_taskCount].name = name;
+  _tasks[_taskCount].deadline = deadline;
+  _tasks[_taskCount].lastTS = millis();
+  return _taskCount++;
+}
+
+void IonoWatchdogClass::checkIn(int task) {
+  if (task >= 0 && task < _taskCount) {
+    _tasks[task].lastTS = millis();
+  }
+}
+
+void IonoWatchdogClass::process() {
+  int task = overrunTask();
+  if (task >= 0) {
+    // Stop feeding, the hardware watchdog will reset the board
+    saveOverrun(task);
+    return;
+  }
+
+  overrunRecord.magic = 0;
+
+  if (_enabled && millis() - _clearTS >= _clearItvl) {
+    hwClear();
+    _clearTS = millis();
+  }
+}
+
+const char *IonoWatchdogClass::lastOverrun() {
+  return _lastOverrun;
+}
+
+// Called from interrupt context when the hardware watchdog
+// is about to expire. If loop() is stuck process() is not
+// running, so record the task with the least slack left,
+// i.e. the one that has been away the longest
+void IonoWatchdogClass::earlyWarning() {
+  if (!_enabled || millis() - _clearTS <= 2 * _clearItvl) {
+    return;
+  }
+  int task = leastSlackTask();
+  if (task >= 0) {
+    saveOverrun(task);
+  }
+}
+
+int IonoWatchdogClass::overrunTask() {
+  unsigned long ts = millis();
+  for (int i = 0; i < _taskCount; i++) {
+    if (ts - _tasks[i].lastTS > _tasks[i].deadline) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int IonoWatchdogClass::leastSlackTask() {
+  unsigned long ts = millis();
+  int task = -1;
+  long minSlack = 0;
+  for (int i = 0; i < _taskCount; i++) {
+    long slack = (long) _tasks[i].deadline - (long) (ts - _tasks[i].lastTS);
+    if (task < 0 || slack < minSlack) {
+      task = i;
+      minSlack = slack;
+    }
+  }
+  return task;
+}
+
+void IonoWatchdogClass::saveOverrun(int task) {
+  const char *name = _tasks[task].name;
+  int i = 0;
+  for (; i < IONO_WDT_NAME_SIZE - 1 && name[i] != '\0'; i++) {
+    overrunRecord.name[i] = name[i];
+  }
+  overrunRecord.name[i] = '\0';
+  overrunRecord.magic = OVERRUN_MAGIC;
+}
+
+#if defined(ARDUINO_ARCH_SAMD)
+
+#if IONO_WDT_ISR
+__attribute__((weak)) void WDT_Handler() {
+  WDT->INTFLAG.reg = WDT_INTFLAG_EW;
+  IonoWatchdog.earlyWarning();
+}
+#endif
+
+void IonoWatchdogClass::hwBegin(unsigned long timeout) {
+  // Set up the generic clock (GCLK2) used to clock the watchdog timer at 1.024kHz
+  REG_GCLK_GENDIV = GCLK_GENDIV_DIV(4) |            // Divide the 32.768kHz clock source by divisor 32, where 2^(4 + 1): 32.768kHz/32=1.024kHz
+                    GCLK_GENDIV_ID(2);              // Select Generic Clock (GCLK) 2
+  while (GCLK->STATUS.bit.SYNCBUSY);                // Wait for synchronization
+
+  REG_GCLK_GENCTRL = GCLK_GENCTRL_DIVSEL |          // Set to divide by 2^(GCLK_GENDIV_DIV(4) + 1)
+                     GCLK_GENCTRL_IDC |             // Set the duty cycle to 50/50 HIGH/LOW
+                     GCLK_GENCTRL_GENEN |           // Enable GCLK2
+                     GCLK_GENCTRL_SRC_OSCULP32K |   // Set the clock source to the ultra low power oscillator (OSCULP32K)
+                     GCLK_GENCTRL_ID(2);            // Select GCLK2
+  while (GCLK->STATUS.bit.SYNCBUSY);                // Wait for synchronization
+
+  // Feed GCLK2 to WDT (Watchdog Timer)
+  REG_GCLK_CLKCTRL = GCLK_CLKCTRL_CLKEN |           // Enable GCLK2 to the WDT
+                     GCLK_CLKCTRL_GEN_GCLK2 |       // Select GCLK2
+                     GCLK_CLKCTRL_ID_WDT;           // Feed the GCLK2 to the WDT
+  while (GCLK->STATUS.bit.SYNCBUSY);                // Wait for synchronization
+
+  // Period is 8 << per clock cycles, from 8 to 16K (about 16 seconds)
+  unsigned long cycles = timeout * 1024 / 1000;
+  uint8_t per = 0;
+  while (per < 11 && (8UL << per) < cycles) {
+    per++;
+  }
+
+  REG_WDT_CONFIG = WDT_CONFIG_PER(per);             // Set the WDT reset timeout
+  while (WDT->STATUS.bit.SYNCBUSY);                 // Wait for synchronization
+  WDT->EWCTRL.reg = WDT_EWCTRL_EWOFFSET(per > 0 ? per - 1 : 0); // Early warning at half period
+#if IONO_WDT_ISR
+  WDT->INTFLAG.reg = WDT_INTFLAG_EW;
+  WDT->INTENSET.reg = WDT_INTENSET_EW;
+  NVIC_EnableIRQ(WDT_IRQn);
+#endif
+  REG_WDT_CTRL = WDT_CTRL_ENABLE;                   // Enable the WDT in normal mode
+  while (WDT->STATUS.bit.SYNCBUSY);                 // Wait for synchronization
+}
+
+void IonoWatchdogClass::hwDisable() {
+  REG_WDT_CTRL &= ~WDT_CTRL_ENABLE;
+  while (WDT->STATUS.bit.SYNCBUSY);
+  WDT->INTENCLR.reg = WDT_INTENCLR_EW;
+}
+
+void IonoWatchdogClass::hwClear() {
+  if (!WDT->STATUS.bit.SYNCBUSY) {
+    REG_WDT_CLEAR = WDT_CLEAR_CLEAR_KEY;
+  }
+}
+
+#elif defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_MEGAAVR)
+
+#ifdef IONO_WDT_EARLY_WARNING
+// Weak, a sketch's own ISR(WDT_vect) takes its place
+ISR(WDT_vect, __attribute__((weak))) {
+  IonoWatchdog.earlyWarning();
+}
+#endif
+
+void IonoWatchdogClass::hwBegin(unsigned long timeout) {
+  // WDTO_* values are 16ms << n, up to 8 seconds
+  uint8_t prescaler = 0;
+  while (prescaler < WDTO_8S && (16UL << prescaler) < timeout) {
+    prescaler++;
+  }
+  wdt_enable(prescaler);
+#ifdef IONO_WDT_EARLY_WARNING
+  // Interrupt and system reset mode: first timeout triggers
+  // the early-warning interrupt, the next one resets
+  WDTCSR |= (1 << WDIE);
+#endif
+}
+
+void IonoWatchdogClass::hwDisable() {
+  wdt_disable();
+}
+
+void IonoWatchdogClass::hwClear() {
+  wdt_reset();
+#ifdef IONO_WDT_EARLY_WARNING
+  WDTCSR |= (1 << WDIE);
+#endif
+}
+
+#elif defined(ARDUINO_ARCH_RP2040)
+
+void IonoWatchdogClass::hwBegin(unsigned long timeout) {
+  if (timeout > 8388) {
+    timeout = 8388;
+  }
+  watchdog_enable(timeout, true);
+  // No early-warning interrupt on the RP2040, use a timer
+  add_repeating_timer_ms(timeout / 2, wdtTimerCallback, NULL, &wdtTimer);
+}
+
+void IonoWatchdogClass::hwDisable() {
+  cancel_repeating_timer(&wdtTimer);
+  hw_clear_bits(&watchdog_hw->ctrl, WATCHDOG_CTRL_ENABLE_BITS);
+}
+
+void IonoWatchdogClass::hwClear() {
+  watchdog_update();
+}
+
+#else
+
+// No hardware watchdog support, deadlines are still tracked
+void IonoWatchdogClass::hwBegin(unsigned long timeout) {
+}
+
+void IonoWatchdogClass::hwDisable() {
+}
+
+void IonoWatchdogClass::hwClear() {
+}
+
+#endif
+
+IonoWatchdogClass IonoWatchdog;
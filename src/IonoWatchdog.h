@@ -0,0 +1,72 @@
+/*
+  IonoWatchdog.h - Task supervisor and hardware watchdog for Iono Uno/MKR/RP
+
+    Copyright (C) 2025 Sfera Labs S.r.l. - All rights reserved.
+
+    For information, see:
+    https://www.sferalabs.cc/
+
+  This code is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  See file LICENSE.txt for further informations on licensing terms.
+*/
+
+#ifndef IonoWatchdog_h
+#define IonoWatchdog_h
+
+#include <Iono.h>
+
+#ifndef IONO_WDT_MAX_TASKS
+#define IONO_WDT_MAX_TASKS 8
+#endif
+
+// The early-warning handler, ISR(WDT_vect) on AVR and WDT_Handler()
+// on SAMD, is weak: a sketch defining its own replaces it, and the
+// overrun is then recorded only if process() gets to see it. Set to
+// 0 in the build flags to leave the interrupt off altogether
+#ifndef IONO_WDT_ISR
+#define IONO_WDT_ISR 1
+#endif
+
+#define IONO_WDT_NAME_SIZE 12
+#define IONO_WDT_CLEAR_ITVL 300
+
+class IonoWatchdogClass
+{
+  public:
+    IonoWatchdogClass();
+    void begin(unsigned long timeout);
+    void disable();
+    int addTask(const char *name, unsigned long deadline);
+    void checkIn(int task);
+    void process();
+    const char *lastOverrun();
+    void earlyWarning();
+
+  private:
+    typedef struct Task
+    {
+      const char *name;
+      unsigned long deadline;
+      unsigned long lastTS;
+    } Task;
+    Task _tasks[IONO_WDT_MAX_TASKS];
+    uint8_t _taskCount;
+    bool _enabled;
+    unsigned long _clearTS;
+    unsigned long _clearItvl;
+    char _lastOverrun[IONO_WDT_NAME_SIZE];
+
+    int overrunTask();
+    int leastSlackTask();
+    void saveOverrun(int task);
+    void hwBegin(unsigned long timeout);
+    void hwDisable();
+    void hwClear();
+};
+
+extern IonoWatchdogClass IonoWatchdog;
+
+#endif
@@ -14,24 +14,96 @@
 */
 
 #include "IonoWeb.h"
+#include <Dns.h>
 
 WebServer IonoWebClass::_webServer;
-
-char *IonoWebClass::_host = (char*) malloc(32);
-int IonoWebClass::_port = 0;
-char *IonoWebClass::_command = (char*) malloc(32);
-unsigned long IonoWebClass::_lastSubscribeTime = 0;
+#if IONO_WEB_RATE_LIMIT
+IonoRateLimiter IonoWebClass::_limiter;
+#endif
+
+IonoWebClass::Subscriber IonoWebClass::_subscribers[IONO_WEB_MAX_SUBSCRIBERS];
+IonoWebClass::Filter IonoWebClass::_eventFilter;
+IonoWebClass::Timer IonoWebClass::_timers[IONO_WEB_MAX_TIMERS];
+unsigned long IonoWebClass::_lastEventTime = 0;
+bool IonoWebClass::_polled = false;
+#if WEBDUINO_WEBSOCKET
+unsigned long IonoWebClass::_lastStateTime = 0;
+#endif
+int16_t IonoWebClass::_state[20];
+uint8_t IonoWebClass::_scanIdx = 0;
+uint32_t IonoWebClass::_stateGen = 0;
+uint32_t IonoWebClass::_cacheGen = 0;
+char IonoWebClass::_stateCache[IONO_WEB_STATE_SIZE];
+uint16_t IonoWebClass::_cacheLen = 0;
+uint16_t IonoWebClass::_etagSalt = 0;
+#if IONO_WEB_HISTORY
+IonoWebClass::Sample IonoWebClass::_history[IONO_WEB_HISTORY_SIZE];
+uint16_t IonoWebClass::_historyHead = 0;
+uint16_t IonoWebClass::_historyLen = 0;
+#endif
+
+const char IonoWebClass::_pinName[][4] PROGMEM = {
+  "DO1",
+  "DO2",
+  "DO3",
+  "DO4",
+  "DO5",
+  "DO6",
+  "DI1",
+  "AV1",
+  "AI1",
+  "DI2",
+  "AV2",
+  "AI2",
+  "DI3",
+  "AV3",
+  "AI3",
+  "DI4",
+  "AV4",
+  "AI4",
+  "DI5",
+  "DI6",
+  "AO1"
+};
 
 void IonoWebClass::begin(int port) {
   _webServer = WebServer("", port);
   _webServer.addCommand("api/state", &IonoWebClass::jsonStateCommand);
   _webServer.addCommand("api/set", &IonoWebClass::setCommand);
+  _webServer.addRoute(WebServer::POST, "api/batch", &IonoWebClass::batchCommand);
+#if IONO_WEB_HISTORY
+  _webServer.addRoute(WebServer::GET, "api/history", &IonoWebClass::historyCommand);
+#endif
+#if IONO_METRICS
+  _webServer.addRoute(WebServer::GET, "metrics", &IonoWebClass::metricsCommand);
+#endif
   _webServer.addCommand("api/subscribe", &IonoWebClass::subscribeCommand);
+  _webServer.addCommand("api/events", &IonoWebClass::eventsCommand);
+#if WEBDUINO_WEBSOCKET
+  _webServer.addCommand("api/ws", &IonoWebClass::webSocketCommand);
+  _webServer.setWebSocketCommand(&IonoWebClass::webSocketMessage);
+#endif
   _webServer.begin();
+  scanState(20);
 }
 
 void IonoWebClass::processRequest() {
-  int len = 128;
+  _polled = true;
+  processTimers();
+  scanState(IONO_WEB_SCAN_STEP);
+#if IONO_WEB_HISTORY
+  recordHistory();
+#endif
+#if IONO_WEB_RATE_LIMIT
+  sendPending();
+#endif
+  processSubscribers();
+  pingEvents();
+#if WEBDUINO_WEBSOCKET
+  sendWebSocketState();
+#endif
+
+  int len = WEBDUINO_URL_LENGTH;
   char buff[len];
   _webServer.processConnection(buff, &len);
 }
@@ -40,114 +112,50 @@ WebServer& IonoWebClass::getWebServer() {
   return _webServer;
 }
 
-void IonoWebClass::jsonStateCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete) {
-  webServer.httpSuccess("application/json");
-  webServer.print("{");
-
-    webServer.print("\"DO1\":");
-    webServer.print(Iono.read(DO1) == HIGH ? 1 : 0);
-    webServer.print(",");
-
-    webServer.print("\"DO2\":");
-    webServer.print(Iono.read(DO2) == HIGH ? 1 : 0);
-    webServer.print(",");
-
-    webServer.print("\"DO3\":");
-    webServer.print(Iono.read(DO3) == HIGH ? 1 : 0);
-    webServer.print(",");
-
-    webServer.print("\"DO4\":");
-    webServer.print(Iono.read(DO4) == HIGH ? 1 : 0);
-    webServer.print(",");
-
-    webServer.print("\"DO5\":");
-    webServer.print(Iono.read(DO5) == HIGH ? 1 : 0);
-    webServer.print(",");
-
-    webServer.print("\"DO6\":");
-    webServer.print(Iono.read(DO6) == HIGH ? 1 : 0);
-    webServer.print(",");
-
-    webServer.print("\"I1\":{");
-      webServer.print("\"D\":");
-      webServer.print(Iono.read(DI1) == HIGH ? 1 : 0);
-      webServer.print(",");
-
-      webServer.print("\"V\":");
-      webServer.print(Iono.read(AV1));
-      webServer.print(",");
-
-      webServer.print("\"I\":");
-      webServer.print(Iono.read(AI1));
-    webServer.print("},");
-
-    webServer.print("\"I2\":{");
-      webServer.print("\"D\":");
-      webServer.print(Iono.read(DI2) == HIGH ? 1 : 0);
-      webServer.print(",");
-
-      webServer.print("\"V\":");
-      webServer.print(Iono.read(AV2));
-      webServer.print(",");
-
-      webServer.print("\"I\":");
-      webServer.print(Iono.read(AI2));
-    webServer.print("},");
-
-    webServer.print("\"I3\":{");
-      webServer.print("\"D\":");
-      webServer.print(Iono.read(DI3) == HIGH ? 1 : 0);
-      webServer.print(",");
-
-      webServer.print("\"V\":");
-      webServer.print(Iono.read(AV3));
-      webServer.print(",");
-
-      webServer.print("\"I\":");
-      webServer.print(Iono.read(AI3));
-    webServer.print("},");
-
-    webServer.print("\"I4\":{");
-      webServer.print("\"D\":");
-      webServer.print(Iono.read(DI4) == HIGH ? 1 : 0);
-      webServer.print(",");
-
-      webServer.print("\"V\":");
-      webServer.print(Iono.read(AV4));
-      webServer.print(",");
-
-      webServer.print("\"I\":");
-      webServer.print(Iono.read(AI4));
-    webServer.print("},");
-
-    webServer.print("\"I5\":{");
-      webServer.print("\"D\":");
-      webServer.print(Iono.read(DI5) == HIGH ? 1 : 0);
-    webServer.print("},");
+#if IONO_WEB_RATE_LIMIT
+IonoRateLimiter& IonoWebClass::getRateLimiter() {
+  return _limiter;
+}
+#endif
 
-    webServer.print("\"I6\":{");
-      webServer.print("\"D\":");
-      webServer.print(Iono.read(DI6) == HIGH ? 1 : 0);
-    webServer.print("}");
+// Serves the cached document, rebuilt only when a full scan
+// finds a change since the last request. The ETag is the scan
+// generation, a client already holding it gets a 304
+void IonoWebClass::jsonStateCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete) {
+  char etag[15];
+  refreshState();
+  formatETag(etag);
+  if (webServer.etagMatches(etag)) {
+    webServer.httpNotModified(etag);
+    return;
+  }
 
-  webServer.print("}");
+  char headers[50] = "Cache-Control: no-cache\r\nETag: ";
+  strcat(headers, etag);
+  strcat(headers, "\r\n");
+  webServer.httpSuccess("application/json", headers, _cacheLen);
+  webServer.write((const uint8_t *) _stateCache, _cacheLen);
 }
 
 void IonoWebClass::setCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete) {
-  if (!tailComplete) {
+  if (!tailComplete || !applySet(webServer, urlTail)) {
     webServer.httpFail();
     return;
   }
 
+  webServer.httpSuccess("text/html; charset=utf-8", NULL, 0);
+}
+
+// Parameters as for api/set, e.g. DO1=1&DO2=f&AO1=5.30
+bool IonoWebClass::applySet(WebServer &webServer, char *params) {
   char name[8];
   char value[8];
   URLPARAM_RESULT rc;
 
-  while (strlen(urlTail)) {
-    rc = webServer.nextURLparam(&urlTail, name, 8, value, 8);
-    if (rc == URLPARAM_EOS) {
-       webServer.httpFail();
-       return;
+  while (strlen(params)) {
+    rc = webServer.nextURLparam(&params, name, 8, value, 8);
+    if (rc != URLPARAM_OK) {
+       return false;
     }
 
     if (strlen(name) == 3) {
@@ -173,8 +181,7 @@ void IonoWebClass::setCommand(WebServer &webServer, WebServer::ConnectionType ty
             pin = DO6;
             break;
           default:
-            webServer.httpFail();
-            return;
+            return false;
         }
 
         if (value[0] == 'f') {
@@ -189,9 +196,608 @@ void IonoWebClass::setCommand(WebServer &webServer, WebServer::ConnectionType ty
     }
   }
 
-  webServer.httpSuccess();
+  for (uint8_t pin = DO1; pin <= DO6; pin++) {
+    scanPin(pin);
+  }
+
+  return true;
 }
 
+// Applies all the outputs of a POST body, or none if any is wrong:
+// {"DO1":1,"DO2":"f","AO1":5.30,"DO3":{"value":1,"delay":2000,"pulse":500}}
+// or DO1=1&DO2=f&AO1=5.30&DO3=1,2000,500 as a form. Delays and pulses
+// in ms, the body is parsed as it is read from the socket
+void IonoWebClass::batchCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete) {
+  static const char keyOutputs[] PROGMEM = "outputs";
+  static const char keyScheduled[] PROGMEM = "scheduled";
+  Output outputs[IONO_WEB_BATCH_SIZE];
+  uint8_t count = 0;
+
+  int ch = nextJsonChar(webServer);
+  webServer.push(ch);
+  bool ok = ch == '{' ? parseBatchJson(webServer, outputs, &count) : parseBatchForm(webServer, outputs, &count);
+
+  uint8_t timers = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    timers += (outputs[i].delay > 0) + (outputs[i].pulse > 0);
+  }
+  if (!ok || timers > freeTimers()) {
+    webServer.httpFail();
+    return;
+  }
+
+  for (uint8_t i = 0; i < count; i++) {
+    Output *output = &outputs[i];
+    if (output->delay == 0) {
+      applyOutput(output->pin, output->value);
+    } else {
+      addTimer(output->pin, output->value, output->delay);
+    }
+    if (output->pulse > 0) {
+      int16_t end = output->value;
+      if (end != IONO_WEB_FLIP) {
+        end = output->pin == AO1 || end >= 100 ? 0 : 100;
+      }
+      addTimer(output->pin, end, output->delay + output->pulse);
+    }
+  }
+
+  char reply[32];
+  IonoJsonWriter json(reply, sizeof(reply));
+  json.beginObject();
+  json.keyP(keyOutputs);
+  json.value(count);
+  json.keyP(keyScheduled);
+  json.value(timers);
+  json.endObject();
+  webServer.httpSuccess("application/json", NULL, json.length());
+  webServer.write((const uint8_t *) reply, json.length());
+}
+
+bool IonoWebClass::parseBatchJson(WebServer &webServer, Output *outputs, uint8_t *count) {
+  char name[8];
+  if (nextJsonChar(webServer) != '{') {
+    return false;
+  }
+
+  int ch = nextJsonChar(webServer);
+  while (ch != '}') {
+    if (ch != '"' || !readJsonString(webServer, name, sizeof(name)) || nextJsonChar(webServer) != ':') {
+      return false;
+    }
+    int pin = outputPin(name);
+    if (pin < 0 || *count == IONO_WEB_BATCH_SIZE) {
+      return false;
+    }
+    Output *output = &outputs[*count];
+    output->pin = pin;
+    output->delay = 0;
+    output->pulse = 0;
+    if (!parseJsonOutput(webServer, output)) {
+      return false;
+    }
+    (*count)++;
+
+    ch = nextJsonChar(webServer);
+    if (ch == ',') {
+      ch = nextJsonChar(webServer);
+      if (ch != '"') {
+        return false;
+      }
+    } else if (ch != '}') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A value, or an object with value and optional delay and pulse
+bool IonoWebClass::parseJsonOutput(WebServer &webServer, Output *output) {
+  char name[8];
+  char num[12];
+  long ms;
+  bool hasValue = false;
+
+  int ch = nextJsonChar(webServer);
+  if (ch != '{') {
+    return readJsonValue(webServer, ch, output->pin, &output->value);
+  }
+
+  ch = nextJsonChar(webServer);
+  while (ch != '}') {
+    if (ch != '"' || !readJsonString(webServer, name, sizeof(name)) || nextJsonChar(webServer) != ':') {
+      return false;
+    }
+    if (strcmp(name, "value") == 0) {
+      if (!readJsonValue(webServer, nextJsonChar(webServer), output->pin, &output->value)) {
+        return false;
+      }
+      hasValue = true;
+    } else if (strcmp(name, "delay") == 0 || strcmp(name, "pulse") == 0) {
+      if (!readJsonNumber(webServer, nextJsonChar(webServer), num, sizeof(num)) || !parseNumber(num, 0, &ms)) {
+        return false;
+      }
+      if (name[0] == 'd') {
+        output->delay = ms;
+      } else {
+        output->pulse = ms;
+      }
+    } else {
+      return false;
+    }
+
+    ch = nextJsonChar(webServer);
+    if (ch == ',') {
+      ch = nextJsonChar(webServer);
+      if (ch != '"') {
+        return false;
+      }
+    } else if (ch != '}') {
+      return false;
+    }
+  }
+  return hasValue;
+}
+
+// A number, true, false or a string as in api/set, e.g. "f"
+bool IonoWebClass::readJsonValue(WebServer &webServer, int ch, uint8_t pin, int16_t *value) {
+  char buff[12];
+  if (ch == '"') {
+    if (!readJsonString(webServer, buff, sizeof(buff))) {
+      return false;
+    }
+  } else if (ch == 't' && webServer.expect("rue")) {
+    strcpy(buff, "1");
+  } else if (ch == 'f' && webServer.expect("alse")) {
+    strcpy(buff, "0");
+  } else if (!readJsonNumber(webServer, ch, buff, sizeof(buff))) {
+    return false;
+  }
+  return parseOutputValue(pin, buff, value);
+}
+
+// After the opening quote, no escapes
+bool IonoWebClass::readJsonString(WebServer &webServer, char *buff, uint8_t size) {
+  uint8_t len = 0;
+  int ch;
+  while ((ch = webServer.read()) != '"') {
+    if (ch == -1 || ch == '\\' || len == size - 1) {
+      return false;
+    }
+    buff[len++] = ch;
+  }
+  buff[len] = '\0';
+  return true;
+}
+
+bool IonoWebClass::readJsonNumber(WebServer &webServer, int ch, char *buff, uint8_t size) {
+  uint8_t len = 0;
+  while ((ch >= '0' && ch <= '9') || ch == '.' || ch == '-') {
+    if (len == size - 1) {
+      return false;
+    }
+    buff[len++] = ch;
+    ch = webServer.read();
+  }
+  webServer.push(ch);
+  buff[len] = '\0';
+  return len > 0;
+}
+
+int IonoWebClass::nextJsonChar(WebServer &webServer) {
+  int ch;
+  do {
+    ch = webServer.read();
+  } while (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n');
+  return ch;
+}
+
+// Value, delay and pulse separated by commas, e.g. DO3=1,2000,500
+bool IonoWebClass::parseBatchForm(WebServer &webServer, Output *outputs, uint8_t *count) {
+  char name[8];
+  char value[32];
+  long ms;
+
+  while (webServer.readPOSTparam(name, sizeof(name), value, sizeof(value))) {
+    int pin = outputPin(name);
+    if (pin < 0 || *count == IONO_WEB_BATCH_SIZE || strlen(value) == sizeof(value) - 1) {
+      return false;
+    }
+    Output *output = &outputs[*count];
+    output->pin = pin;
+    output->delay = 0;
+    output->pulse = 0;
+
+    char *delay = strchr(value, ',');
+    char *pulse = NULL;
+    if (delay != NULL) {
+      *delay++ = '\0';
+      pulse = strchr(delay, ',');
+      if (pulse != NULL) {
+        *pulse++ = '\0';
+      }
+    }
+    if (!parseOutputValue(pin, value, &output->value)) {
+      return false;
+    }
+    if (delay != NULL) {
+      if (!parseNumber(delay, 0, &ms)) {
+        return false;
+      }
+      output->delay = ms;
+    }
+    if (pulse != NULL) {
+      if (!parseNumber(pulse, 0, &ms)) {
+        return false;
+      }
+      output->pulse = ms;
+    }
+    (*count)++;
+  }
+  return true;
+}
+
+// 0, 1 or f for the relays, 0 to 10.00 V for AO1, in hundredths
+bool IonoWebClass::parseOutputValue(uint8_t pin, const char *str, int16_t *value) {
+  long number;
+  if (strcmp(str, "f") == 0 && pin != AO1) {
+    *value = IONO_WEB_FLIP;
+    return true;
+  }
+  if (pin == AO1) {
+    if (!parseNumber(str, 2, &number) || number > 1000) {
+      return false;
+    }
+  } else {
+    if (!parseNumber(str, 0, &number) || number > 1) {
+      return false;
+    }
+    number *= 100;
+  }
+  *value = number;
+  return true;
+}
+
+// Non-negative decimal number scaled by the given decimals,
+// e.g. "5.3" is 530 with 2. Further decimals are dropped
+bool IonoWebClass::parseNumber(const char *str, uint8_t decimals, long *number) {
+  long n = 0;
+  int8_t dec = -1;
+  bool digits = false;
+  for (; *str != '\0'; str++) {
+    if (*str == '.' && dec < 0 && decimals > 0) {
+      dec = 0;
+      continue;
+    }
+    if (*str < '0' || *str > '9' || n > 99999999) {
+      return false;
+    }
+    digits = true;
+    if (dec >= 0) {
+      if (dec == decimals) {
+        continue;
+      }
+      dec++;
+    }
+    n = n * 10 + *str - '0';
+  }
+  if (!digits) {
+    return false;
+  }
+  for (dec = dec < 0 ? 0 : dec; dec < decimals; dec++) {
+    n *= 10;
+  }
+  *number = n;
+  return true;
+}
+
+int IonoWebClass::outputPin(const char *name) {
+  for (uint8_t pin = DO1; pin <= AO1; pin++) {
+    if ((pin <= DO6 || pin == AO1) && strcmp_P(name, _pinName[pin]) == 0) {
+      return pin;
+    }
+  }
+  return -1;
+}
+
+void IonoWebClass::applyOutput(uint8_t pin, int16_t value) {
+  if (value == IONO_WEB_FLIP) {
+    Iono.flip(pin);
+  } else if (pin == AO1) {
+    Iono.write(AO1, value / 100.0);
+  } else {
+    Iono.write(pin, value >= 100 ? HIGH : LOW);
+  }
+}
+
+uint8_t IonoWebClass::freeTimers() {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < IONO_WEB_MAX_TIMERS; i++) {
+    if (!_timers[i].active) {
+      count++;
+    }
+  }
+  return count;
+}
+
+// Takes the first free slot, so that changes due at the same
+// time are applied in the order they were added
+void IonoWebClass::addTimer(uint8_t pin, int16_t value, unsigned long delay) {
+  for (uint8_t i = 0; i < IONO_WEB_MAX_TIMERS; i++) {
+    Timer *timer = &_timers[i];
+    if (!timer->active) {
+      timer->active = true;
+      timer->pin = pin;
+      timer->value = value;
+      timer->ts = millis();
+      timer->delay = delay;
+      return;
+    }
+  }
+}
+
+void IonoWebClass::processTimers() {
+  for (uint8_t i = 0; i < IONO_WEB_MAX_TIMERS; i++) {
+    Timer *timer = &_timers[i];
+    if (timer->active && millis() - timer->ts >= timer->delay) {
+      timer->active = false;
+      applyOutput(timer->pin, timer->value);
+    }
+  }
+}
+
+#if IONO_WEB_HISTORY
+// Samples of one analog input, e.g. api/history?ch=AV1&from=3600000&points=60
+// for the last hour in at most 60 points. from is in ms before now, the
+// whole buffer if omitted. With more samples than points, consecutive
+// samples are grouped in buckets and each point is [age, min, max] of
+// a bucket, the age in ms of its first sample:
+// {"ch":"AV1","itvl":10000,"points":[[3590012,5.30,5.42],...]}
+// Sent in chunks while the buckets are computed
+void IonoWebClass::historyCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete) {
+  static const char keyCh[] PROGMEM = "ch";
+  static const char keyItvl[] PROGMEM = "itvl";
+  static const char keyPoints[] PROGMEM = "points";
+  int column = -1;
+  long from = -1;
+  long points = IONO_WEB_HISTORY_SIZE;
+
+  char name[8];
+  char value[12];
+  URLPARAM_RESULT rc;
+
+  while (tailComplete && strlen(urlTail)) {
+    rc = webServer.nextURLparam(&urlTail, name, 8, value, 12);
+    if (rc != URLPARAM_OK) {
+      column = -1;
+      break;
+    }
+
+    if (strcmp(name, "ch") == 0) {
+      column = historyColumn(value);
+    } else if (strcmp(name, "from") == 0) {
+      if (!parseNumber(value, 0, &from)) {
+        column = -1;
+        break;
+      }
+    } else if (strcmp(name, "points") == 0) {
+      if (!parseNumber(value, 0, &points) || points == 0) {
+        column = -1;
+        break;
+      }
+    }
+  }
+
+  if (column < 0) {
+    webServer.httpFail();
+    return;
+  }
+
+  webServer.beginChunked("application/json", "Cache-Control: no-cache\r\n");
+  if (type == WebServer::HEAD) {
+    return;
+  }
+
+  char buff[64];
+  strcpy_P(name, _pinName[DI1 + 1 + column / 2 * 3 + column % 2]);
+  IonoJsonWriter json(buff, sizeof(buff), &webServer);
+  json.beginObject();
+  json.keyP(keyCh);
+  json.string(name);
+  json.keyP(keyItvl);
+  json.value(IONO_WEB_HISTORY_ITVL);
+  json.keyP(keyPoints);
+  json.beginArray();
+  writeHistory(json, column, from, points > IONO_WEB_HISTORY_SIZE ? IONO_WEB_HISTORY_SIZE : points);
+  json.endArray();
+  json.endObject();
+  json.flush();
+  webServer.endChunked();
+}
+
+// Min and max of buckets of about the same number of samples,
+// from the oldest sample not older than from
+void IonoWebClass::writeHistory(IonoJsonWriter &json, uint8_t column, unsigned long from, uint16_t points) {
+  unsigned long now = millis();
+  uint16_t first = (_historyHead + IONO_WEB_HISTORY_SIZE - _historyLen) % IONO_WEB_HISTORY_SIZE;
+  uint16_t count = _historyLen;
+  while (count > 0 && now - _history[first].ts > from) {
+    first = (first + 1) % IONO_WEB_HISTORY_SIZE;
+    count--;
+  }
+  if (count == 0) {
+    return;
+  }
+  if (count < points) {
+    points = count;
+  }
+
+  uint16_t bucket = 0;
+  uint16_t start = 0;
+  uint16_t end = count / points;
+  int16_t min = 0;
+  int16_t max = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    int16_t value = _history[(first + i) % IONO_WEB_HISTORY_SIZE].value[column];
+    if (i == start || value < min) {
+      min = value;
+    }
+    if (i == start || value > max) {
+      max = value;
+    }
+    if (i + 1 == end) {
+      json.beginArray();
+      json.value(now - _history[(first + start) % IONO_WEB_HISTORY_SIZE].ts);
+      json.fixed(min, 2);
+      json.fixed(max, 2);
+      json.endArray();
+      bucket++;
+      start = end;
+      end = (uint32_t) (bucket + 1) * count / points;
+    }
+  }
+}
+
+// One row of all the analog values every IONO_WEB_HISTORY_ITVL,
+// the oldest is overwritten when full
+void IonoWebClass::recordHistory() {
+  unsigned long now = millis();
+  if (_historyLen > 0) {
+    uint16_t last = (_historyHead + IONO_WEB_HISTORY_SIZE - 1) % IONO_WEB_HISTORY_SIZE;
+    if (now - _history[last].ts < IONO_WEB_HISTORY_ITVL) {
+      return;
+    }
+  }
+
+  Sample *sample = &_history[_historyHead];
+  sample->ts = now;
+  for (uint8_t i = 0; i < 8; i++) {
+    sample->value[i] = _state[DI1 + 1 + i / 2 * 3 + i % 2];
+  }
+  _historyHead = (_historyHead + 1) % IONO_WEB_HISTORY_SIZE;
+  if (_historyLen < IONO_WEB_HISTORY_SIZE) {
+    _historyLen++;
+  }
+}
+
+// AV1..AV4 or AI1..AI4, -1 for other names
+int IonoWebClass::historyColumn(const char *name) {
+  for (uint8_t column = 0; column < 8; column++) {
+    if (strcmp_P(name, _pinName[DI1 + 1 + column / 2 * 3 + column % 2]) == 0) {
+      return column;
+    }
+  }
+  return -1;
+}
+#endif
+
+#if IONO_METRICS
+// Counters in the Prometheus text format. Maxima are since the
+// previous scrape
+void IonoWebClass::metricsCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete) {
+  P(uptime) = "iono_uptime_seconds";
+  P(loop) = "iono_loop_seconds";
+  P(scan) = "iono_scan_seconds";
+  P(notifications) = "iono_notifications_total";
+  P(rateLimited) = "iono_rate_limited_total";
+  P(dropped) = "iono_dropped_total";
+  P(coalesced) = "iono_coalesced_total";
+  P(modbusFrames) = "iono_modbus_frames_total";
+  P(modbusErrors) = "iono_modbus_errors_total";
+  P(httpRequests) = "iono_http_requests_total";
+  P(sockets) = "iono_sockets_used";
+  P(freeMemory) = "iono_free_memory_bytes";
+
+  webServer.beginChunked("text/plain; version=0.0.4");
+  if (type == WebServer::HEAD) {
+    return;
+  }
+
+  printMetric(webServer, uptime, "gauge", NULL, millis() / 1000);
+  printTiming(webServer, loop, &IonoMetrics.loop);
+  printTiming(webServer, scan, &IonoMetrics.scan);
+  printMetric(webServer, notifications, "counter", "transport=\"http\"", IonoMetrics.notifications[IONO_METRIC_HTTP]);
+  printMetric(webServer, notifications, NULL, "transport=\"events\"", IonoMetrics.notifications[IONO_METRIC_EVENTS]);
+  printMetric(webServer, notifications, NULL, "transport=\"udp\"", IonoMetrics.notifications[IONO_METRIC_UDP]);
+  printMetric(webServer, rateLimited, "counter", NULL, IonoMetrics.rateLimited);
+  printMetric(webServer, dropped, "counter", NULL, IonoMetrics.dropped);
+  printMetric(webServer, coalesced, "counter", NULL, IonoMetrics.coalesced);
+  printMetric(webServer, modbusFrames, "counter", NULL, IonoMetrics.modbusFrames);
+  printMetric(webServer, modbusErrors, "counter", NULL, IonoMetrics.modbusErrors);
+  printMetric(webServer, httpRequests, "counter", NULL, IonoMetrics.httpRequests);
+
+  uint8_t subscribers = 0;
+  for (uint8_t i = 0; i < IONO_WEB_MAX_SUBSCRIBERS; i++) {
+    if (_subscribers[i].client) {
+      subscribers++;
+    }
+  }
+  printMetric(webServer, sockets, "gauge", "owner=\"http\"", webServer.clientCount());
+  printMetric(webServer, sockets, NULL, "owner=\"subscribers\"", subscribers);
+
+  long free = ionoFreeMemory();
+  if (free >= 0) {
+    printMetric(webServer, freeMemory, "gauge", NULL, free);
+  }
+  webServer.endChunked();
+
+  ionoMetricsResetMax();
+}
+
+// The # TYPE line only with type, for the first of a family
+void IonoWebClass::printMetric(WebServer &webServer, const unsigned char *name, const char *type, const char *labels, uint32_t value) {
+  if (type != NULL) {
+    webServer.print("# TYPE ");
+    webServer.printP(name);
+    webServer.print(' ');
+    webServer.print(type);
+    webServer.print('\n');
+  }
+  webServer.printP(name);
+  if (labels != NULL) {
+    webServer.print('{');
+    webServer.print(labels);
+    webServer.print('}');
+  }
+  webServer.print(' ');
+  webServer.print(value);
+  webServer.print('\n');
+}
+
+// A summary without quantiles, plus a <name>_max gauge
+void IonoWebClass::printTiming(WebServer &webServer, const unsigned char *name, IonoTiming *timing) {
+  webServer.print("# TYPE ");
+  webServer.printP(name);
+  webServer.print(" summary\n");
+  webServer.printP(name);
+  webServer.print("_sum ");
+  printSeconds(webServer, timing->sumUs);
+  webServer.printP(name);
+  webServer.print("_count ");
+  webServer.print(timing->count);
+  webServer.print("\n# TYPE ");
+  webServer.printP(name);
+  webServer.print("_max gauge\n");
+  webServer.printP(name);
+  webServer.print("_max ");
+  printSeconds(webServer, timing->maxUs);
+}
+
+void IonoWebClass::printSeconds(WebServer &webServer, uint64_t us) {
+  char frac[8];
+  uint32_t rest = us % 1000000;
+  frac[0] = '.';
+  for (int8_t i = 6; i > 0; i--) {
+    frac[i] = '0' + rest % 10;
+    rest /= 10;
+  }
+  frac[7] = '\0';
+  webServer.print((unsigned long) (us / 1000000));
+  webServer.print(frac);
+  webServer.print('\n');
+}
+#endif
+
 void IonoWebClass::subscribeCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete) {
   if (!tailComplete) {
     webServer.httpFail();
@@ -201,21 +807,23 @@ void IonoWebClass::subscribeCommand(WebServer &webServer, WebServer::ConnectionT
   unsigned long stableTime = 0;
   float minVariation = 0;
 
-  char host[32];
+  char host[32] = "";
   int port = 80;
-  char command[32];
+  char command[32] = "/";
+  unsigned long lease = SUBSCRIBE_TIMEOUT / 1000;
+  uint32_t channels = 0;
   uint8_t mode1 = 1;
   uint8_t mode2 = 1;
   uint8_t mode3 = 1;
   uint8_t mode4 = 1;
 
   char name[8];
-  char value[32];
+  char value[64];
   URLPARAM_RESULT rc;
 
   while (strlen(urlTail)) {
-    rc = webServer.nextURLparam(&urlTail, name, 8, value, 32);
-    if (rc == URLPARAM_EOS) {
+    rc = webServer.nextURLparam(&urlTail, name, 8, value, 64);
+    if (rc != URLPARAM_OK) {
       webServer.httpFail();
       return;
     }
@@ -227,13 +835,31 @@ void IonoWebClass::subscribeCommand(WebServer &webServer, WebServer::ConnectionT
       minVariation = atof(value);
 
     } else if (strcmp(name, "host") == 0) {
-      strncpy(host, value, 32);
+      if (strlen(value) >= sizeof(host)) {
+        webServer.httpFail();
+        return;
+      }
+      strcpy(host, value);
 
     } else if (strcmp(name, "port") == 0) {
       port = atoi(value);
 
     } else if (strcmp(name, "cmd") == 0) {
-      strncpy(command, value, 32);
+      if (strlen(value) >= sizeof(command)) {
+        webServer.httpFail();
+        return;
+      }
+      strcpy(command, value);
+
+    } else if (strcmp(name, "lease") == 0) {
+      lease = atol(value);
+
+    } else if (strcmp(name, "ch") == 0) {
+      channels = parseChannels(value);
+      if (channels == 0) {
+        webServer.httpFail();
+        return;
+      }
 
     } else if (strcmp(name, "mode1") == 0) {
       switch (value[0]) {
@@ -281,212 +907,684 @@ void IonoWebClass::subscribeCommand(WebServer &webServer, WebServer::ConnectionT
     }
   }
 
-  subscribe(stableTime, minVariation, host, port, command, mode1, mode2, mode3, mode4);
+  if (channels == 0) {
+    channels = modeChannels(mode1, mode2, mode3, mode4);
+  }
+
+  Filter filter;
+  setFilter(&filter, stableTime, minVariation, channels);
+  if (host[0] == '\0' || !addSubscriber(host, port, command, &filter, lease)) {
+    webServer.httpFail();
+    return;
+  }
   jsonStateCommand(webServer, type, urlTail, tailComplete);
 }
 
-void IonoWebClass::subscribe(unsigned long stableTime, float minVariation, char *host, int port, char *command, uint8_t mode1, uint8_t mode2, uint8_t mode3, uint8_t mode4) {
-  strncpy(_host, host, 32);
-  _port = port;
-  strncpy(_command, command, 32);
-
-  Iono.subscribeDigital(DO1, stableTime, &callDigitalURL);
-  Iono.subscribeDigital(DO2, stableTime, &callDigitalURL);
-  Iono.subscribeDigital(DO3, stableTime, &callDigitalURL);
-  Iono.subscribeDigital(DO4, stableTime, &callDigitalURL);
-  Iono.subscribeDigital(DO5, stableTime, &callDigitalURL);
-  Iono.subscribeDigital(DO6, stableTime, &callDigitalURL);
-
-  switch (mode1) {
-    case 3:
-      Iono.subscribeAnalog(AI1, stableTime, minVariation, &callAnalogURL);
-      break;
+// Streams the changes of the subscribed pins as Server-Sent Events.
+// Optional st, mv, ch and mode1..mode4 parameters as for api/subscribe,
+// shared by all the streams and WebSockets: while any is open, other
+// parameters are refused
+void IonoWebClass::eventsCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete) {
+  if (!tailComplete || !subscribeParams(webServer, urlTail) || !webServer.httpEventStream()) {
+    webServer.httpFail();
+    return;
+  }
 
-    case 2:
-      Iono.subscribeAnalog(AV1, stableTime, minVariation, &callAnalogURL);
-      break;
+  refreshState();
 
-    default:
-      Iono.subscribeDigital(DI1, stableTime, &callDigitalURL);
+  webServer.print("event: state\ndata: ");
+  webServer.write((const uint8_t *) _stateCache, _cacheLen);
+  webServer.print("\n\n");
+}
+
+#if WEBDUINO_WEBSOCKET
+// Same parameters and messages as api/events over a WebSocket, which
+// also takes the api/set parameters as messages, e.g. "DO1=1&DO2=f",
+// and "state". Both are answered with the whole state
+void IonoWebClass::webSocketCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete) {
+  if (!tailComplete || !subscribeParams(webServer, urlTail) || !webServer.httpWebSocket()) {
+    webServer.httpFail();
+    return;
   }
 
-  switch (mode2) {
-    case 3:
-      Iono.subscribeAnalog(AI2, stableTime, minVariation, &callAnalogURL);
-      break;
+  webSocketMessage(webServer, (char *) "state", 5, false);
+}
 
-    case 2:
-      Iono.subscribeAnalog(AV2, stableTime, minVariation, &callAnalogURL);
-      break;
+void IonoWebClass::webSocketMessage(WebServer &webServer, char *message, int length, bool binary) {
+  if (binary || (strcmp(message, "state") != 0 && !applySet(webServer, message))) {
+    webServer.writeWebSocket((const uint8_t *) "error", 5);
+    return;
+  }
+
+  refreshState();
 
-    default:
-      Iono.subscribeDigital(DI2, stableTime, &callDigitalURL);
+  webServer.writeWebSocket((const uint8_t *) _stateCache, _cacheLen);
+}
+#endif
+
+bool IonoWebClass::subscribeParams(WebServer &webServer, char *params) {
+  unsigned long stableTime = 0;
+  float minVariation = 0;
+  uint8_t mode[4] = {1, 1, 1, 1};
+  uint32_t channels = 0;
+  bool found = false;
+
+  char name[8];
+  char value[64];
+  URLPARAM_RESULT rc;
+
+  while (strlen(params)) {
+    rc = webServer.nextURLparam(&params, name, 8, value, 64);
+    if (rc != URLPARAM_OK) {
+      return false;
+    }
+
+    found = true;
+    if (strcmp(name, "st") == 0) {
+      stableTime = atol(value);
+
+    } else if (strcmp(name, "mv") == 0) {
+      minVariation = atof(value);
+
+    } else if (strcmp(name, "ch") == 0) {
+      channels = parseChannels(value);
+      if (channels == 0) {
+        return false;
+      }
+
+    } else if (strncmp(name, "mode", 4) == 0 && name[4] >= '1' && name[4] <= '4' && name[5] == '\0') {
+      mode[name[4] - '1'] = value[0] == 'i' ? 3 : value[0] == 'v' ? 2 : 1;
+    }
   }
 
-  switch (mode3) {
-    case 3:
-      Iono.subscribeAnalog(AI3, stableTime, minVariation, &callAnalogURL);
-      break;
+  if (found || _eventFilter.channels == 0) {
+    if (channels == 0) {
+      channels = modeChannels(mode[0], mode[1], mode[2], mode[3]);
+    }
+    Filter filter;
+    setFilter(&filter, stableTime, minVariation, channels);
+    if (_webServer.streamCount() + _webServer.webSocketCount() > 0
+        && (filter.channels != _eventFilter.channels
+            || filter.stableTime != _eventFilter.stableTime
+            || filter.deadband != _eventFilter.deadband)) {
+      // The filter is shared, it can't change under open streams
+      return false;
+    }
+    _eventFilter = filter;
+    subscribeInputs();
+  }
+  return true;
+}
 
-    case 2:
-      Iono.subscribeAnalog(AV3, stableTime, minVariation, &callAnalogURL);
-      break;
+void IonoWebClass::subscribe(unsigned long stableTime, float minVariation, char *host, int port, char *command, uint8_t mode1, uint8_t mode2, uint8_t mode3, uint8_t mode4) {
+  subscribe(stableTime, minVariation, host, port, command, mode1, mode2, mode3, mode4, SUBSCRIBE_TIMEOUT / 1000);
+}
 
-    default:
-      Iono.subscribeDigital(DI3, stableTime, &callDigitalURL);
+bool IonoWebClass::subscribe(unsigned long stableTime, float minVariation, char *host, int port, char *command, uint8_t mode1, uint8_t mode2, uint8_t mode3, uint8_t mode4, unsigned long lease) {
+  Filter filter;
+  setFilter(&filter, stableTime, minVariation, modeChannels(mode1, mode2, mode3, mode4));
+  return addSubscriber(host, port, command, &filter, lease);
+}
+
+// Subscribing again with the same host, port and command updates the
+// filter and renews the lease, a lease of 0 removes the subscriber
+bool IonoWebClass::addSubscriber(const char *host, uint16_t port, const char *command, Filter *filter, unsigned long lease) {
+  if (lease > IONO_WEB_MAX_LEASE) {
+    lease = IONO_WEB_MAX_LEASE;
+  }
+  int i = findSubscriber(host, port, command);
+  if (i < 0) {
+    if (lease == 0) {
+      return true;
+    }
+    for (int j = 0; j < IONO_WEB_MAX_SUBSCRIBERS; j++) {
+      if (_subscribers[j].lease == 0) {
+        i = j;
+        break;
+      }
+    }
+    if (i < 0) {
+      return false;
+    }
+    Subscriber *sub = &_subscribers[i];
+    strncpy(sub->host, host, sizeof(sub->host) - 1);
+    sub->host[sizeof(sub->host) - 1] = '\0';
+    strncpy(sub->command, command, sizeof(sub->command) - 1);
+    sub->command[sizeof(sub->command) - 1] = '\0';
+    sub->port = port;
+    sub->resolved = false;
+    sub->pending = 0;
   }
 
-  switch (mode4) {
-    case 3:
-      Iono.subscribeAnalog(AI4, stableTime, minVariation, &callAnalogURL);
-      break;
+  Subscriber *sub = &_subscribers[i];
+  if (lease == 0) {
+    closeURL(sub);
+    sub->lease = 0;
+  } else {
+    sub->filter = *filter;
+    sub->ts = millis();
+    sub->lease = lease * 1000;
+    sub->retryDelay = 0;
+  }
+  subscribeInputs();
+  return true;
+}
 
-    case 2:
-      Iono.subscribeAnalog(AV4, stableTime, minVariation, &callAnalogURL);
-      break;
+int IonoWebClass::findSubscriber(const char *host, uint16_t port, const char *command) {
+  for (int i = 0; i < IONO_WEB_MAX_SUBSCRIBERS; i++) {
+    Subscriber *sub = &_subscribers[i];
+    if (sub->lease != 0 && sub->port == port && strncmp(sub->host, host, sizeof(sub->host) - 1) == 0
+        && strncmp(sub->command, command, sizeof(sub->command) - 1) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void IonoWebClass::setFilter(Filter *filter, unsigned long stableTime, float minVariation, uint32_t channels) {
+  filter->channels = channels;
+  filter->stableTime = stableTime;
+  filter->deadband = (uint16_t) (minVariation * 100 + 0.5);
+  for (uint8_t i = 0; i < 20; i++) {
+    filter->value[i] = -1;
+  }
+}
+
+// True if the channel is in the set and, for analog channels, has
+// moved by at least the deadband since the last value passed
+bool IonoWebClass::filterPass(Filter *filter, uint8_t pin, int16_t value) {
+  if (!(filter->channels & (1UL << pin)) || value == filter->value[pin]) {
+    return false;
+  }
+  if (filter->value[pin] >= 0 && pin >= DI1 && pin < DI5 && (pin - DI1) % 3 != 0) {
+    int16_t diff = value - filter->value[pin];
+    if (abs(diff) < filter->deadband) {
+      return false;
+    }
+  }
+  filter->value[pin] = value;
+  return true;
+}
+
+// The outputs, DI5, DI6 and inputs 1 to 4 as digital (1),
+// voltage (2) or current (3)
+uint32_t IonoWebClass::modeChannels(uint8_t mode1, uint8_t mode2, uint8_t mode3, uint8_t mode4) {
+  uint8_t mode[] = {mode1, mode2, mode3, mode4};
+  uint32_t channels = (1UL << DI5) | (1UL << DI6);
+  for (uint8_t pin = DO1; pin <= DO6; pin++) {
+    channels |= 1UL << pin;
+  }
+  for (uint8_t i = 0; i < 4; i++) {
+    uint8_t m = mode[i] >= 1 && mode[i] <= 3 ? mode[i] : 1;
+    channels |= 1UL << (DI1 + 3 * i + m - 1);
+  }
+  return channels;
+}
 
-    default:
-      Iono.subscribeDigital(DI4, stableTime, &callDigitalURL);
+// Comma separated pin names, e.g. "DO1,DI2,AV3", 0 if any is unknown
+uint32_t IonoWebClass::parseChannels(char *list) {
+  uint32_t channels = 0;
+  char *name = strtok(list, ",");
+  while (name != NULL) {
+    uint8_t pin = 0;
+    while (pin < 20 && strcmp_P(name, _pinName[pin]) != 0) {
+      pin++;
+    }
+    if (pin == 20) {
+      return 0;
+    }
+    channels |= 1UL << pin;
+    name = strtok(NULL, ",");
   }
+  return channels;
+}
 
+// Sets up the single change detection pass feeding all the
+// subscribers: the union of their channels, with the shortest stable
+// time and the smallest deadband. Inputs 1 to 4 are read in one mode
+// at a time, current over voltage over digital
+void IonoWebClass::subscribeInputs() {
+  uint32_t channels = _eventFilter.channels;
+  unsigned long stableTime = _eventFilter.stableTime;
+  uint16_t deadband = _eventFilter.deadband;
+  bool found = _eventFilter.channels != 0;
+
+  for (uint8_t i = 0; i < IONO_WEB_MAX_SUBSCRIBERS; i++) {
+    Filter *filter = &_subscribers[i].filter;
+    if (_subscribers[i].lease == 0) {
+      continue;
+    }
+    if (!found || filter->stableTime < stableTime) {
+      stableTime = filter->stableTime;
+    }
+    if (!found || filter->deadband < deadband) {
+      deadband = filter->deadband;
+    }
+    channels |= filter->channels;
+    found = true;
+  }
+
+  if (!found) {
+    return;
+  }
+
+  float minVariation = deadband / 100.0;
+  for (uint8_t pin = DO1; pin <= DO6; pin++) {
+    Iono.subscribeDigital(pin, stableTime, &callDigitalURL);
+  }
+  for (uint8_t pin = DI1; pin < DI5; pin += 3) {
+    if (channels & (1UL << (pin + 2))) {
+      Iono.subscribeAnalog(pin + 2, stableTime, minVariation, &callAnalogURL);
+    } else if (channels & (1UL << (pin + 1))) {
+      Iono.subscribeAnalog(pin + 1, stableTime, minVariation, &callAnalogURL);
+    } else {
+      Iono.subscribeDigital(pin, stableTime, &callDigitalURL);
+    }
+  }
   Iono.subscribeDigital(DI5, stableTime, &callDigitalURL);
   Iono.subscribeDigital(DI6, stableTime, &callDigitalURL);
-  _lastSubscribeTime = millis();
 }
 
 void IonoWebClass::callDigitalURL(uint8_t pin, float value) {
-  const char *v = value == HIGH ? "1" : "0";
-  switch (pin) {
-    case DI1:
-      callURL("DI1", v);
-      break;
+#if IONO_WEB_RATE_LIMIT
+  if (!_limiter.allow(pin, value)) {
+    return;
+  }
+#endif
+  notify(pin, value);
+}
 
-    case DI2:
-      callURL("DI2", v);
-      break;
+void IonoWebClass::callAnalogURL(uint8_t pin, float value) {
+#if IONO_WEB_RATE_LIMIT
+  if (!_limiter.allow(pin, value)) {
+    return;
+  }
+#endif
+  notify(pin, value);
+}
 
-    case DI3:
-      callURL("DI3", v);
-      break;
+#if IONO_WEB_RATE_LIMIT
+// Sends the throttled changes as soon as the limiter allows
+void IonoWebClass::sendPending() {
+  float value;
+  int pin;
+  while ((pin = _limiter.next(&value)) >= 0) {
+    notify(pin, value);
+  }
+}
+#endif
+
+// Every change goes to the event streams and the subscribers,
+// each through its own filter
+void IonoWebClass::notify(uint8_t pin, float value) {
+  int16_t v = (int16_t) (value * 100 + 0.5);
+  if (filterPass(&_eventFilter, pin, v)) {
+    sendEvent(pin, v);
+  }
+  queueURL(pin, v);
+  if (!_polled) {
+    flushSubscribers();
+  }
+}
 
-    case DI4:
-      callURL("DI4", v);
-      break;
+// data: {"DI1":1} on event streams, {"DI1":1} on WebSockets
+void IonoWebClass::sendEvent(uint8_t pin, int16_t value) {
+  if (_webServer.streamCount() == 0 && _webServer.webSocketCount() == 0) {
+    return;
+  }
 
-    case DI5:
-      callURL("DI5", v);
-      break;
+  char event[32];
+  IonoJsonWriter json(event, sizeof(event));
+  json.raw("data: ");
+  json.beginObject();
+  json.keyP(_pinName[pin]);
+  writeValue(json, pin, value);
+  json.endObject();
+  json.raw("\n\n");
+  uint16_t len = json.length();
+  IONO_METRIC_ADD(notifications[IONO_METRIC_EVENTS], _webServer.streamCount() + _webServer.webSocketCount());
+
+  if (_webServer.streamCount() > 0) {
+    _webServer.writeStreams((const uint8_t *) event, len);
+    _lastEventTime = millis();
+  }
+  if (_webServer.webSocketCount() > 0) {
+    _webServer.broadcastWebSocket((const uint8_t *) event + 6, len - 8);
+  }
+}
 
-    case DI6:
-      callURL("DI6", v);
-      break;
+void IonoWebClass::pingEvents() {
+  if (millis() - _lastEventTime >= IONO_WEB_EVENTS_PING) {
+    if (_webServer.streamCount() > 0) {
+      _webServer.writeStreams((const uint8_t *) ":\n\n", 3);
+    }
+    _lastEventTime = millis();
+  }
+}
 
-    case DO1:
-      callURL("DO1", v);
-      break;
+#if WEBDUINO_WEBSOCKET
+void IonoWebClass::sendWebSocketState() {
+  if (millis() - _lastStateTime >= IONO_WEB_WS_STATE_ITVL) {
+    if (_webServer.webSocketCount() > 0) {
+      refreshState();
+      _webServer.broadcastWebSocket((const uint8_t *) _stateCache, _cacheLen);
+    }
+    _lastStateTime = millis();
+  }
+}
+#endif
+
+// Only the latest value of each pin is kept, all the pins changed
+// are sent together with the next request
+void IonoWebClass::queueURL(uint8_t pin, int16_t value) {
+  for (uint8_t i = 0; i < IONO_WEB_MAX_SUBSCRIBERS; i++) {
+    Subscriber *sub = &_subscribers[i];
+    if (sub->lease != 0 && filterPass(&sub->filter, pin, value)) {
+      if (sub->pending != 0) {
+        IONO_METRIC_INC(coalesced);
+      }
+      sub->pending |= 1UL << pin;
+    }
+  }
+}
 
-    case DO2:
-      callURL("DO2", v);
-      break;
+// Frees the expired subscribers and advances the requests of the others
+void IonoWebClass::processSubscribers() {
+  bool expired = false;
+  for (uint8_t i = 0; i < IONO_WEB_MAX_SUBSCRIBERS; i++) {
+    Subscriber *sub = &_subscribers[i];
+    if (sub->lease == 0) {
+      continue;
+    }
+    if (millis() - sub->ts >= sub->lease) {
+      closeURL(sub);
+      sub->lease = 0;
+      expired = true;
+      continue;
+    }
+    processURL(sub);
+  }
 
-    case DO3:
-      callURL("DO3", v);
-      break;
+  if (expired) {
+    subscribeInputs();
+  }
+}
 
-    case DO4:
-      callURL("DO4", v);
-      break;
+// Without processRequest() nothing would advance the queue: the
+// request goes out right away and the connection is closed without
+// waiting for the response, one connection attempt per change
+void IonoWebClass::flushSubscribers() {
+  for (uint8_t i = 0; i < IONO_WEB_MAX_SUBSCRIBERS; i++) {
+    Subscriber *sub = &_subscribers[i];
+    if (sub->lease == 0 || sub->pending == 0) {
+      continue;
+    }
+    if (millis() - sub->ts >= sub->lease) {
+      closeURL(sub);
+      sub->lease = 0;
+      continue;
+    }
+    sub->retryDelay = 0;
+    processURL(sub);
+    closeURL(sub);
+  }
+}
 
-    case DO5:
-      callURL("DO5", v);
-      break;
+// Drives the requests to the subscribed URL, one step per call and
+// without waiting for the subscriber: at most one connection attempt,
+// then the response is read as it comes in. Connections are reused
+// when the subscriber keeps them alive
+void IonoWebClass::processURL(Subscriber *sub) {
+  if (sub->state != URL_IDLE) {
+    readResponse(sub);
+    return;
+  }
 
-    case DO6:
-      callURL("DO6", v);
-      break;
+  if (sub->client && (!sub->client.connected() || millis() - sub->urlTS > IONO_WEB_IDLE_TIMEOUT)) {
+    closeURL(sub);
   }
-}
 
-void IonoWebClass::callAnalogURL(uint8_t pin, float value) {
-  char sVal[6];
-  ftoa(sVal, value);
-  switch (pin) {
-    case AV1:
-      callURL("AV1", sVal);
-      break;
+  if (sub->pending == 0 || millis() - sub->urlTS < sub->retryDelay) {
+    return;
+  }
 
-    case AI1:
-      callURL("AI1", sVal);
-      break;
+  if (!sub->client && !connectURL(sub)) {
+    sub->retryDelay = sub->retryDelay == 0 ? IONO_WEB_RETRY_MIN : sub->retryDelay * 2;
+    if (sub->retryDelay > IONO_WEB_RETRY_MAX) {
+      sub->retryDelay = IONO_WEB_RETRY_MAX;
+    }
+    sub->urlTS = millis();
+    return;
+  }
 
-    case AV2:
-      callURL("AV2", sVal);
-      break;
+  sub->retryDelay = 0;
+  sendURL(sub);
+}
 
-    case AI2:
-      callURL("AI2", sVal);
-      break;
+bool IonoWebClass::connectURL(Subscriber *sub) {
+  if (!sub->resolved) {
+    if (!sub->ip.fromString(sub->host)) {
+      DNSClient dns;
+      dns.begin(Ethernet.dnsServerIP());
+      if (dns.getHostByName(sub->host, sub->ip) != 1) {
+        return false;
+      }
+    }
+    sub->resolved = true;
+  }
 
-    case AV3:
-      callURL("AV3", sVal);
-      break;
+#if IONO_WEB_CONNECT_TIMEOUT > 0 && !defined(ARDUINO_AVR_LEONARDO_ETH)
+  sub->client.setConnectionTimeout(IONO_WEB_CONNECT_TIMEOUT);
+#endif
+  if (!sub->client.connect(sub->ip, sub->port)) {
+    sub->client.stop();
+    return false;
+  }
+  return true;
+}
 
-    case AI3:
-      callURL("AI3", sVal);
-      break;
+// GET <cmd>?DI1=1&AV3=5.30 HTTP/1.1, assembled to go out in one packet
+void IonoWebClass::sendURL(Subscriber *sub) {
+  char buff[IONO_WEB_REQUEST_SIZE];
+  uint16_t len = appendRequest(sub, buff, 0, "GET ");
+  len = appendRequest(sub, buff, len, sub->command);
+
+  char sep[] = "?";
+  char sVal[14];
+  char name[4];
+  for (uint8_t pin = 0; pin < 20; pin++) {
+    if (sub->pending & (1UL << pin)) {
+      formatValue(sVal, pin, sub->filter.value[pin]);
+      strcpy_P(name, _pinName[pin]);
+      len = appendRequest(sub, buff, len, sep);
+      len = appendRequest(sub, buff, len, name);
+      len = appendRequest(sub, buff, len, "=");
+      len = appendRequest(sub, buff, len, sVal);
+      sep[0] = '&';
+    }
+  }
 
-    case AV4:
-      callURL("AV4", sVal);
-      break;
+  len = appendRequest(sub, buff, len, " HTTP/1.1\r\nHost: ");
+  len = appendRequest(sub, buff, len, sub->host);
+  len = appendRequest(sub, buff, len, "\r\n\r\n");
+  sub->client.write((const uint8_t *) buff, len);
+  IONO_METRIC_INC(notifications[IONO_METRIC_HTTP]);
+
+  sub->pending = 0;
+  sub->reusable = false;
+  sub->bodyLeft = -1;
+  sub->lineLen = 0;
+  sub->state = URL_WAITING;
+  sub->urlTS = millis();
+}
 
-    case AI4:
-      callURL("AI4", sVal);
-      break;
+uint16_t IonoWebClass::appendRequest(Subscriber *sub, char *buff, uint16_t len, const char *str) {
+  while (*str != '\0') {
+    if (len == IONO_WEB_REQUEST_SIZE) {
+      sub->client.write((const uint8_t *) buff, len);
+      len = 0;
+    }
+    buff[len++] = *str++;
   }
+  return len;
 }
 
-void IonoWebClass::callURL(const char *pin, const char *value) {
-  if (_port != 0) {
-    if (millis() > _lastSubscribeTime + SUBSCRIBE_TIMEOUT) {
-      _port = 0;
-      return;
+// Reads the bytes available of the response. The connection is kept
+// for the next request only if the subscriber sent an HTTP/1.1
+// response with Content-Length and not Connection: close, the body
+// is then discarded
+void IonoWebClass::readResponse(Subscriber *sub) {
+  int ch;
+  while (sub->state != URL_IDLE && (ch = sub->client.read()) != -1) {
+    sub->urlTS = millis();
+
+    if (sub->state == URL_HEADERS_DONE) {
+      if (--sub->bodyLeft <= 0) {
+        sub->state = URL_IDLE;
+      }
+      continue;
     }
 
-    EthernetClient client;
-    for (uint8_t i = 0; i < 4; i++) {
-      if (client.connect(_host, _port)) {
-        client.print("GET ");
-        client.print(_command);
-        client.print("?");
-        client.print(pin);
-        client.print("=");
-        client.print(value);
-        client.println(" HTTP/1.1");
-        client.println("Connection: close");
-        client.println();
-        break;
+    if (ch == '\r') {
+      continue;
+    }
+    if (ch != '\n') {
+      if (sub->lineLen < sizeof(sub->line) - 1) {
+        sub->line[sub->lineLen++] = ch;
       }
+      continue;
+    }
+
+    char *line = sub->line;
+    line[sub->lineLen] = '\0';
+    if (sub->lineLen == 0) {
+      if (!sub->reusable || sub->bodyLeft < 0) {
+        closeURL(sub);
+        return;
+      }
+      sub->state = sub->bodyLeft == 0 ? URL_IDLE : URL_HEADERS_DONE;
+    } else if (strncmp(line, "HTTP/", 5) == 0) {
+      sub->reusable = strncmp(line, "HTTP/1.1", 8) == 0;
+    } else if (strncasecmp(line, "Content-Length:", 15) == 0) {
+      sub->bodyLeft = atol(line + 15);
+    } else if (strncasecmp(line, "Connection:", 11) == 0) {
+      char *v = line + 11;
+      while (*v == ' ') {
+        v++;
+      }
+      if (strncasecmp(v, "close", 5) == 0) {
+        sub->reusable = false;
+      }
+    }
+    sub->lineLen = 0;
+  }
+
+  if (sub->state != URL_IDLE && (!sub->client.connected() || millis() - sub->urlTS > IONO_WEB_RESPONSE_TIMEOUT)) {
+    closeURL(sub);
+  }
+}
+
+void IonoWebClass::closeURL(Subscriber *sub) {
+  sub->client.stop();
+  sub->state = URL_IDLE;
+}
+
+// Reads the next channels round-robin, bumping the
+// generation counter when a value has changed
+void IonoWebClass::scanState(uint8_t count) {
+  while (count-- > 0) {
+    scanPin(_scanIdx);
+    _scanIdx = (_scanIdx + 1) % 20;
+  }
+}
+
+void IonoWebClass::scanPin(uint8_t pin) {
+  int16_t value = (int16_t) (Iono.read(pin) * 100 + 0.5);
+  if (value != _state[pin]) {
+    _state[pin] = value;
+    _stateGen++;
+  }
+}
+
+// The round-robin scan can be a few calls behind the I/O, read
+// all the channels before serving the state
+void IonoWebClass::refreshState() {
+  scanState(20);
+  if (_cacheLen == 0 || _cacheGen != _stateGen) {
+    updateStateCache();
+  }
+}
+
+void IonoWebClass::updateStateCache() {
+  static const char keyD[] PROGMEM = "D";
+  static const char keyV[] PROGMEM = "V";
+  static const char keyI[] PROGMEM = "I";
+  char inKey[] = "I1";
+  IonoJsonWriter json(_stateCache, IONO_WEB_STATE_SIZE);
+  json.beginObject();
+
+  for (uint8_t pin = DO1; pin <= DO6; pin++) {
+    json.keyP(_pinName[pin]);
+    writeValue(json, pin, _state[pin]);
+  }
+
+  for (uint8_t i = 0; i < 6; i++) {
+    uint8_t pin = i < 4 ? DI1 + 3 * i : DI5 + i - 4;
+    inKey[1] = '1' + i;
+    json.key(inKey);
+    json.beginObject();
+    json.keyP(keyD);
+    writeValue(json, pin, _state[pin]);
+    if (i < 4) {
+      json.keyP(keyV);
+      writeValue(json, pin + 1, _state[pin + 1]);
+      json.keyP(keyI);
+      writeValue(json, pin + 2, _state[pin + 2]);
     }
-    client.stop();
+    json.endObject();
   }
+
+  json.endObject();
+  _cacheLen = json.length();
+  _cacheGen = _stateGen;
 }
 
-void IonoWebClass::ftoa(char *sVal, float fVal) {
-  fVal += 0.005;
+// "<salt><generation>" in hex. The salt is taken from the time of
+// the first request, so that tags from before a reset don't match
+void IonoWebClass::formatETag(char *etag) {
+  static const char hex[] = "0123456789abcdef";
+  if (_etagSalt == 0) {
+    _etagSalt = micros() | 1;
+  }
+  uint32_t gen = _stateGen;
+  etag[0] = '"';
+  for (int8_t i = 3; i >= 0; i--) {
+    etag[4 - i] = hex[(_etagSalt >> (4 * i)) & 0xf];
+  }
+  for (int8_t i = 7; i >= 0; i--) {
+    etag[12 - i] = hex[(gen >> (4 * i)) & 0xf];
+  }
+  etag[13] = '"';
+  etag[14] = '\0';
+}
 
-  int dVal = fVal;
-  int dec = (int)(fVal * 100) % 100;
+// Values are in hundredths, digital ones are sent as 0 or 1
+void IonoWebClass::writeValue(IonoJsonWriter &json, uint8_t pin, int16_t value) {
+  if (pin >= DI1 && pin < DI5 && (pin - DI1) % 3 != 0) {
+    json.fixed(value, 2);
+  } else {
+    json.value(value >= 100 ? 1 : 0);
+  }
+}
 
-  int i = 0;
-  int d = dVal / 10;
-  if (d != 0) {
-    sVal[i++] = d + '0';
+// sVal must hold 14 chars, as for IonoJsonWriter::fixed()
+void IonoWebClass::formatValue(char *sVal, uint8_t pin, int16_t value) {
+  if (pin >= DI1 && pin < DI5 && (pin - DI1) % 3 != 0) {
+    IonoJsonWriter::formatFixed(sVal, value, 2);
+  } else {
+    sVal[0] = value >= 100 ? '1' : '0';
+    sVal[1] = '\0';
   }
-  sVal[i++] = (dVal % 10) + '0';
-  sVal[i++] = '.';
-  sVal[i++] = (dec / 10) + '0';
-  sVal[i++] = (dec % 10) + '0';
-  sVal[i] = '\0';
 }
 
 IonoWebClass IonoWeb;
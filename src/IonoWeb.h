@@ -18,32 +18,286 @@
 
 #include <Iono.h>
 #include "WebServer.h"
+#include "IonoRateLimiter.h"
+#include "IonoJson.h"
+#include "IonoMetrics.h"
 
 #define SUBSCRIBE_TIMEOUT 60000
 
+// Each subscriber holds its own connection, mind the sockets
+// left to the web server
+#ifndef IONO_WEB_MAX_SUBSCRIBERS
+#ifdef __AVR__
+#define IONO_WEB_MAX_SUBSCRIBERS 1
+#else
+#define IONO_WEB_MAX_SUBSCRIBERS 4
+#endif
+#endif
+
+#define IONO_WEB_MAX_LEASE 3600
+
+// Bounds the blocking connect() to the subscriber, needs the
+// Ethernet library 2.0 or later, 0 to leave the library default
+#ifndef IONO_WEB_CONNECT_TIMEOUT
+#define IONO_WEB_CONNECT_TIMEOUT 500
+#endif
+
+// Delay before connecting again after a failure, doubled each time
+#define IONO_WEB_RETRY_MIN 250
+#define IONO_WEB_RETRY_MAX 8000
+
+#define IONO_WEB_RESPONSE_TIMEOUT 2000
+#define IONO_WEB_IDLE_TIMEOUT 5000
+
+#define URL_IDLE 0
+#define URL_WAITING 1
+#define URL_HEADERS_DONE 2
+
+// Channels read per processRequest() call to notice changes between
+// requests, the state is read in full before it is served
+#ifndef IONO_WEB_SCAN_STEP
+#define IONO_WEB_SCAN_STEP 4
+#endif
+
+#define IONO_WEB_STATE_SIZE 224
+
+// Notification requests are assembled in a buffer of this size on the
+// stack, a longer one goes out in more packets
+#ifndef IONO_WEB_REQUEST_SIZE
+#ifdef __AVR__
+#define IONO_WEB_REQUEST_SIZE 96
+#else
+#define IONO_WEB_REQUEST_SIZE IONO_WEB_STATE_SIZE
+#endif
+#endif
+
+// Comment sent on idle event streams to find out closed clients
+#ifndef IONO_WEB_EVENTS_PING
+#define IONO_WEB_EVENTS_PING 15000
+#endif
+
+// Period of the whole state sent on WebSocket connections
+#ifndef IONO_WEB_WS_STATE_ITVL
+#define IONO_WEB_WS_STATE_ITVL 5000
+#endif
+
+// Outputs accepted in one api/batch request, and delayed
+// changes, pulse ends included, waiting at the same time
+#ifndef IONO_WEB_BATCH_SIZE
+#ifdef __AVR__
+#define IONO_WEB_BATCH_SIZE 8
+#else
+#define IONO_WEB_BATCH_SIZE 32
+#endif
+#endif
+
+#ifndef IONO_WEB_MAX_TIMERS
+#ifdef __AVR__
+#define IONO_WEB_MAX_TIMERS 4
+#else
+#define IONO_WEB_MAX_TIMERS 16
+#endif
+#endif
+
+#define IONO_WEB_FLIP -1
+
+// Rate limiting of the notifications, see getRateLimiter(). Its
+// buckets take about 245 bytes of RAM, so it is left out on AVR
+#ifndef IONO_WEB_RATE_LIMIT
+#ifdef __AVR__
+#define IONO_WEB_RATE_LIMIT 0
+#else
+#define IONO_WEB_RATE_LIMIT 1
+#endif
+#endif
+
+// Samples of the analog inputs kept for api/history, taken all
+// together every IONO_WEB_HISTORY_ITVL ms. The defaults hold the
+// last hour in about 7KB, so it is off unless built with
+// -DIONO_WEB_HISTORY=1, e.g. with arduino-cli:
+//   --build-property "compiler.cpp.extra_flags=-DIONO_WEB_HISTORY=1"
+// or by setting it to 1 here. Not available on the Uno
+#ifndef IONO_WEB_HISTORY
+#define IONO_WEB_HISTORY 0
+#endif
+
+#ifndef IONO_WEB_HISTORY_SIZE
+#define IONO_WEB_HISTORY_SIZE 360
+#endif
+
+#ifndef IONO_WEB_HISTORY_ITVL
+#define IONO_WEB_HISTORY_ITVL 10000
+#endif
+
 class IonoWebClass
 {
   public:
     static void begin(int port);
     static void processRequest();
+    // Input changes are queued and sent by processRequest() without
+    // blocking. Sketches that never call it, only Iono.process(), get
+    // one request per change sent from the Iono callback, as before.
+    // The second form returns false when all the subscribers are taken
     static void subscribe(unsigned long stableTime, float minVariation, char *host, int port, char *command, uint8_t mode1, uint8_t mode2, uint8_t mode3, uint8_t mode4);
+    static bool subscribe(unsigned long stableTime, float minVariation, char *host, int port, char *command, uint8_t mode1, uint8_t mode2, uint8_t mode3, uint8_t mode4, unsigned long lease);
     static WebServer& getWebServer();
+#if IONO_WEB_RATE_LIMIT
+    static IonoRateLimiter& getRateLimiter();
+#endif
 
   private:
     static WebServer _webServer;
+#if IONO_WEB_RATE_LIMIT
+    static IonoRateLimiter _limiter;
+#endif
+
+    static const char _pinName[][4];
 
-    static char *_host;
-    static int _port;
-    static char *_command;
-    static unsigned long _lastSubscribeTime;
+    typedef struct Filter
+    {
+      uint32_t channels;
+      unsigned long stableTime;
+      uint16_t deadband;
+      int16_t value[20];
+    } Filter;
+
+    typedef struct Subscriber
+    {
+      char host[32];
+      uint16_t port;
+      char command[32];
+      unsigned long ts;
+      unsigned long lease;
+      Filter filter;
+      uint32_t pending;
+      IPAddress ip;
+      bool resolved;
+      EthernetClient client;
+      uint8_t state;
+      bool reusable;
+      long bodyLeft;
+      unsigned long urlTS;
+      unsigned long retryDelay;
+      char line[24];
+      uint8_t lineLen;
+    } Subscriber;
+    static Subscriber _subscribers[IONO_WEB_MAX_SUBSCRIBERS];
+
+    typedef struct Output
+    {
+      uint8_t pin;
+      int16_t value;
+      unsigned long delay;
+      unsigned long pulse;
+    } Output;
+
+    typedef struct Timer
+    {
+      bool active;
+      uint8_t pin;
+      int16_t value;
+      unsigned long ts;
+      unsigned long delay;
+    } Timer;
+    static Timer _timers[IONO_WEB_MAX_TIMERS];
+
+#if IONO_WEB_HISTORY
+    // AV1, AI1, AV2, AI2, ... as in _state
+    typedef struct Sample
+    {
+      unsigned long ts;
+      int16_t value[8];
+    } Sample;
+    static Sample _history[IONO_WEB_HISTORY_SIZE];
+    static uint16_t _historyHead;
+    static uint16_t _historyLen;
+#endif
+
+    static Filter _eventFilter;
+    static unsigned long _lastEventTime;
+    static bool _polled;
+#if WEBDUINO_WEBSOCKET
+    static unsigned long _lastStateTime;
+#endif
+    static int16_t _state[20];
+    static uint8_t _scanIdx;
+    static uint32_t _stateGen;
+    static uint32_t _cacheGen;
+    static char _stateCache[IONO_WEB_STATE_SIZE];
+    static uint16_t _cacheLen;
+    static uint16_t _etagSalt;
 
     static void setCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete);
     static void jsonStateCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete);
     static void subscribeCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete);
+    static void eventsCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete);
+#if WEBDUINO_WEBSOCKET
+    static void webSocketCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete);
+    static void webSocketMessage(WebServer &webServer, char *message, int length, bool binary);
+#endif
+    static bool applySet(WebServer &webServer, char *params);
+    static void batchCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete);
+    static bool parseBatchJson(WebServer &webServer, Output *outputs, uint8_t *count);
+    static bool parseJsonOutput(WebServer &webServer, Output *output);
+    static bool readJsonValue(WebServer &webServer, int ch, uint8_t pin, int16_t *value);
+    static bool readJsonString(WebServer &webServer, char *buff, uint8_t size);
+    static bool readJsonNumber(WebServer &webServer, int ch, char *buff, uint8_t size);
+    static int nextJsonChar(WebServer &webServer);
+    static bool parseBatchForm(WebServer &webServer, Output *outputs, uint8_t *count);
+    static bool parseOutputValue(uint8_t pin, const char *str, int16_t *value);
+    static bool parseNumber(const char *str, uint8_t decimals, long *number);
+    static int outputPin(const char *name);
+    static void applyOutput(uint8_t pin, int16_t value);
+    static uint8_t freeTimers();
+    static void addTimer(uint8_t pin, int16_t value, unsigned long delay);
+    static void processTimers();
+#if IONO_WEB_HISTORY
+    static void historyCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete);
+    static void writeHistory(IonoJsonWriter &json, uint8_t column, unsigned long from, uint16_t points);
+    static void recordHistory();
+    static int historyColumn(const char *name);
+#endif
+#if IONO_METRICS
+    static void metricsCommand(WebServer &webServer, WebServer::ConnectionType type, char* urlTail, bool tailComplete);
+    static void printMetric(WebServer &webServer, const unsigned char *name, const char *type, const char *labels, uint32_t value);
+    static void printTiming(WebServer &webServer, const unsigned char *name, IonoTiming *timing);
+    static void printSeconds(WebServer &webServer, uint64_t us);
+#endif
+    static bool subscribeParams(WebServer &webServer, char *params);
+    static bool addSubscriber(const char *host, uint16_t port, const char *command, Filter *filter, unsigned long lease);
+    static int findSubscriber(const char *host, uint16_t port, const char *command);
+    static void setFilter(Filter *filter, unsigned long stableTime, float minVariation, uint32_t channels);
+    static bool filterPass(Filter *filter, uint8_t pin, int16_t value);
+    static uint32_t modeChannels(uint8_t mode1, uint8_t mode2, uint8_t mode3, uint8_t mode4);
+    static uint32_t parseChannels(char *list);
+    static void subscribeInputs();
     static void callDigitalURL(uint8_t pin, float value);
     static void callAnalogURL(uint8_t pin, float value);
-    static void callURL(const char *pin, const char *value);
-    static void ftoa(char *sVal, float fVal);
+#if IONO_WEB_RATE_LIMIT
+    static void sendPending();
+#endif
+    static void notify(uint8_t pin, float value);
+    static void sendEvent(uint8_t pin, int16_t value);
+    static void pingEvents();
+#if WEBDUINO_WEBSOCKET
+    static void sendWebSocketState();
+#endif
+    static void queueURL(uint8_t pin, int16_t value);
+    static void processSubscribers();
+    static void flushSubscribers();
+    static void processURL(Subscriber *sub);
+    static bool connectURL(Subscriber *sub);
+    static void sendURL(Subscriber *sub);
+    static uint16_t appendRequest(Subscriber *sub, char *buff, uint16_t len, const char *str);
+    static void readResponse(Subscriber *sub);
+    static void closeURL(Subscriber *sub);
+    static void scanState(uint8_t count);
+    static void scanPin(uint8_t pin);
+    static void refreshState();
+    static void updateStateCache();
+    static void formatETag(char *etag);
+    static void writeValue(IonoJsonWriter &json, uint8_t pin, int16_t value);
+    static void formatValue(char *sVal, uint8_t pin, int16_t value);
 };
 
 extern IonoWebClass IonoWeb;
@@ -24,6 +24,7 @@
 */
 
 #include <WebServer.h>
+#include "IonoMetrics.h"
 
 WebServer::WebServer(const char *urlPrefix, uint16_t port) :
   m_server(port),
@@ -31,9 +32,22 @@ WebServer::WebServer(const char *urlPrefix, uint16_t port) :
   m_urlPrefix(urlPrefix),
   m_pushbackDepth(0),
   m_contentLength(0),
+  m_keepAlive(false),
+  m_chunked(false),
+  m_chunkSent(false),
+  m_persist(false),
+  m_stream(false),
+  m_webSocket(false),
+  m_conn(NULL),
+  m_rxConn(NULL),
+  m_rxPos(0),
+  m_rxLen(0),
+  m_authConn(NULL),
+  m_webSocketCmd(NULL),
   m_failureCmd(&defaultFailCmd),
   m_defaultCmd(&defaultFailCmd),
   m_cmdCount(0),
+  m_exactCount(0),
   m_urlPathCmd(NULL),
   m_bufFill(0)
 {
@@ -58,11 +72,44 @@ void WebServer::setFailureCommand(Command *cmd)
 
 void WebServer::addCommand(const char *verb, Command *cmd)
 {
-  if (m_cmdCount < SIZE(m_commands))
+  insertCommand(verb, cmd, 0xFF);
+}
+
+void WebServer::addRoute(ConnectionType method, const char *path, Command *cmd)
+{
+  uint8_t methods = 1 << method;
+  if (method == GET)
+    methods |= 1 << HEAD;
+  insertCommand(path, cmd, methods);
+}
+
+const char *WebServer::routeParam(uint8_t index)
+{
+  return index < WEBDUINO_ROUTE_PARAMS ? m_routeParams[index] : NULL;
+}
+
+void WebServer::insertCommand(const char *verb, Command *cmd, uint8_t methods)
+{
+  if (m_cmdCount >= SIZE(m_commands))
+    return;
+
+  uint8_t pos = m_cmdCount;
+  size_t len = strlen(verb);
+  if (strchr(verb, '{') == NULL && (len == 0 || verb[len - 1] != '*'))
   {
-    m_commands[m_cmdCount].verb = verb;
-    m_commands[m_cmdCount++].cmd = cmd;
+    // after the equal paths, so they are tried in the order added
+    pos = 0;
+    while (pos < m_exactCount && strcmp(m_commands[pos].verb, verb) <= 0)
+      pos++;
+    memmove(&m_commands[pos + 1], &m_commands[pos],
+            (m_cmdCount - pos) * sizeof(m_commands[0]));
+    m_exactCount++;
   }
+
+  m_commands[pos].verb = verb;
+  m_commands[pos].cmd = cmd;
+  m_commands[pos].methods = methods;
+  m_cmdCount++;
 }
 
 void WebServer::setUrlPathCommand(UrlPathCommand *cmd)
@@ -70,22 +117,37 @@ void WebServer::setUrlPathCommand(UrlPathCommand *cmd)
   m_urlPathCmd = cmd;
 }
 
+void WebServer::setWebSocketCommand(WebSocketCommand *cmd)
+{
+  m_webSocketCmd = cmd;
+}
+
 size_t WebServer::write(uint8_t ch)
 {
   m_buffer[m_bufFill++] = ch;
 
   if(m_bufFill == sizeof(m_buffer))
-  {
-    m_client.write(m_buffer, sizeof(m_buffer));
-    m_bufFill = 0;
-  }
+    flushBuf();
 
   return sizeof(ch);
 }
 
+// Small blocks are added to the output buffer, the ones that would
+// fill it are sent as they are after what is buffered
 size_t WebServer::write(const uint8_t *buffer, size_t size)
 {
-  flushBuf(); //Flush any buffered output
+  if (size < sizeof(m_buffer) - m_bufFill)
+  {
+    memcpy(m_buffer + m_bufFill, buffer, size);
+    m_bufFill += size;
+    return size;
+  }
+  flushBuf();
+  if (m_chunked)
+  {
+    writeChunk(buffer, size);
+    return size;
+  }
   return m_client.write(buffer, size);
 }
 
@@ -93,31 +155,62 @@ void WebServer::flushBuf()
 {
   if(m_bufFill > 0)
   {
-    m_client.write(m_buffer, m_bufFill);
+    if (m_chunked)
+      writeChunk(m_buffer, m_bufFill);
+    else
+      m_client.write(m_buffer, m_bufFill);
     m_bufFill = 0;
   }
 }
 
-void WebServer::writeP(const unsigned char *data, size_t length)
+// The CRLF ending a chunk goes out with the size of the next one,
+// so that each chunk takes two writes to the socket
+void WebServer::writeChunk(const uint8_t *data, size_t size)
 {
-  // copy data out of program memory into local storage
-
-  while (length--)
+  static const char hex[] = "0123456789abcdef";
+  char header[12];
+  uint8_t len = 0;
+  if (m_chunkSent)
   {
-    write(pgm_read_byte(data++));
+    header[len++] = '\r';
+    header[len++] = '\n';
   }
+  int8_t shift = 0;
+  while ((size >> shift) > 15 && shift < 28)
+    shift += 4;
+  for (; shift >= 0; shift -= 4)
+    header[len++] = hex[(size >> shift) & 0xf];
+  header[len++] = '\r';
+  header[len++] = '\n';
+  m_client.write((const uint8_t *) header, len);
+  m_client.write(data, size);
+  m_chunkSent = true;
 }
 
-void WebServer::printP(const unsigned char *str)
+void WebServer::writeP(const unsigned char *data, size_t length)
 {
-  // copy data out of program memory into local storage
-
-  while (uint8_t value = pgm_read_byte(str++))
+  // copy data out of program memory into the output buffer, as
+  // much as it fits at a time
+  while (length > 0)
   {
-    write(value);
+    size_t n = sizeof(m_buffer) - m_bufFill;
+    if (n > length)
+      n = length;
+    memcpy_P(m_buffer + m_bufFill, data, n);
+    m_bufFill += n;
+    data += n;
+    length -= n;
+
+    if (m_bufFill == sizeof(m_buffer))
+      flushBuf();
   }
 }
 
+void WebServer::printP(const unsigned char *str)
+{
+  writeP(str, strlen_P((const char *)str));
+}
+
 void WebServer::printCRLF()
 {
   print(CRLF);
@@ -152,6 +245,8 @@ void WebServer::printCRLF()
 bool WebServer::dispatchCommand(ConnectionType requestType, char *verb,
         bool tail_complete)
 {
+  memset(m_routeParams, 0, sizeof(m_routeParams));
+
   // if there is no URL, i.e. we have a prefix and it's requested without a
   // trailing slash or if the URL is just the slash
   if ((verb[0] == 0) || ((verb[0] == '/') && (verb[1] == 0)))
@@ -171,10 +266,10 @@ bool WebServer::dispatchCommand(ConnectionType requestType, char *verb,
   // if the first character is a slash,  there's more after it.
   if (verb[0] == '/')
   {
-    uint8_t i;
     char *qm_loc;
     uint16_t verb_len;
     uint8_t qm_offset;
+    uint8_t allowed;
     // Skip over the leading "/",  because it makes the code more
     // efficient and easier to understand.
     verb++;
@@ -183,18 +278,20 @@ bool WebServer::dispatchCommand(ConnectionType requestType, char *verb,
     qm_loc = strchr(verb, '?');
     verb_len = (qm_loc == NULL) ? strlen(verb) : (qm_loc - verb);
     qm_offset = (qm_loc == NULL) ? 0 : 1;
-    for (i = 0; i < m_cmdCount; ++i)
+    int i = findCommand(requestType, verb, verb_len, &allowed);
+    if (i >= 0)
     {
-      if ((verb_len == strlen(m_commands[i].verb))
-          && (strncmp(verb, m_commands[i].verb, verb_len) == 0))
-      {
-        // Skip over the "verb" part of the URL (and the question
-        // mark, if present) when passing it to the "action" routine
-        m_commands[i].cmd(*this, requestType,
-        verb + verb_len + qm_offset,
-        tail_complete);
-        return true;
-      }
+      // Skip over the "verb" part of the URL (and the question
+      // mark, if present) when passing it to the "action" routine
+      m_commands[i].cmd(*this, requestType,
+      verb + verb_len + qm_offset,
+      tail_complete);
+      return true;
+    }
+    if (allowed != 0)
+    {
+      httpMethodNotAllowed(allowed);
+      return true;
     }
     // Check if UrlPathCommand is assigned.
     if (m_urlPathCmd != NULL)
@@ -230,6 +327,120 @@ bool WebServer::dispatchCommand(ConnectionType requestType, char *verb,
   return false;
 }
 
+// Index of the command for the first verb_len chars of verb, -1 if
+// none.  allowed gets the methods of the routes matching the path
+// but not the method
+int WebServer::findCommand(ConnectionType requestType, char *verb,
+                           uint16_t verb_len, uint8_t *allowed)
+{
+  uint8_t method = 1 << requestType;
+  *allowed = 0;
+
+  int lo = 0;
+  int hi = m_exactCount;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (compareVerb(verb, verb_len, m_commands[mid].verb) > 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  for (int i = lo; i < m_exactCount
+       && compareVerb(verb, verb_len, m_commands[i].verb) == 0; i++)
+  {
+    if (m_commands[i].methods & method)
+      return i;
+    *allowed |= m_commands[i].methods;
+  }
+
+  for (int i = m_exactCount; i < m_cmdCount; i++)
+  {
+    if (matchRoute(m_commands[i].verb, verb, verb_len, false))
+    {
+      if (m_commands[i].methods & method)
+      {
+        matchRoute(m_commands[i].verb, verb, verb_len, true);
+        return i;
+      }
+      *allowed |= m_commands[i].methods;
+    }
+  }
+  return -1;
+}
+
+// strcmp() of the first verb_len chars of verb with route
+int WebServer::compareVerb(const char *verb, uint16_t verb_len,
+                           const char *route)
+{
+  int r = strncmp(verb, route, verb_len);
+  if (r != 0)
+    return r;
+  return route[verb_len] == 0 ? 0 : -1;
+}
+
+// With capture set, the values of the {name} and * parts are NUL
+// terminated in place and saved for routeParam()
+bool WebServer::matchRoute(const char *route, char *verb, uint16_t verb_len,
+                           bool capture)
+{
+  char *end = verb + verb_len;
+  char *starts[WEBDUINO_ROUTE_PARAMS];
+  char *stops[WEBDUINO_ROUTE_PARAMS];
+  uint8_t n = 0;
+
+  while (*route != 0)
+  {
+    if (*route == '*' && route[1] == 0)
+    {
+      if (n < WEBDUINO_ROUTE_PARAMS)
+      {
+        starts[n] = verb;
+        stops[n++] = end;
+      }
+      verb = end;
+      break;
+    }
+
+    if (*route == '{')
+    {
+      char *start = verb;
+      while (verb < end && *verb != '/')
+        verb++;
+      if (verb == start)
+        return false;
+      while (*route != 0 && *route != '}')
+        route++;
+      if (*route == '}')
+        route++;
+      if (n < WEBDUINO_ROUTE_PARAMS)
+      {
+        starts[n] = start;
+        stops[n++] = verb;
+      }
+      continue;
+    }
+
+    if (verb == end || *route != *verb)
+      return false;
+    route++;
+    verb++;
+  }
+
+  if (verb != end)
+    return false;
+
+  if (capture)
+  {
+    for (uint8_t i = 0; i < n; i++)
+    {
+      m_routeParams[i] = starts[i];
+      *stops[i] = 0;
+    }
+  }
+  return true;
+}
+
 // processConnection with a default buffer
 void WebServer::processConnection()
 {
@@ -240,193 +451,1233 @@ void WebServer::processConnection()
 
 void WebServer::processConnection(char *buff, int *bufflen)
 {
-  int urlPrefixLen = strlen(m_urlPrefix);
+  int size = *bufflen;
+
+  acceptConnection();
+
+  // each client gets at most WEBDUINO_PARSE_BUDGET bytes parsed and
+  // one request served per call, whatever it is sending
+  for (uint8_t i = 0; i < WEBDUINO_MAX_CLIENTS; i++)
+  {
+    Connection &conn = m_conns[i];
+    if (!conn.client)
+      continue;
+
+    if (conn.state == STREAMING)
+    {
+      // nothing expected from the client, just drop it
+      releaseBuffers(conn);
+      if (m_rxPos == m_rxLen)
+        conn.client.read(m_rx, sizeof(m_rx));
+      else
+        conn.client.read();
+      if (!conn.client.connected())
+        closeConnection(conn);
+    }
+    else if (conn.state == WEBSOCKET)
+    {
+      parseWebSocket(conn);
+      if (conn.client && !conn.client.connected())
+        closeConnection(conn);
+    }
+    else if (parseRequest(conn))
+    {
+      serveRequest(conn, buff, size, bufflen);
+    }
+    else if (!conn.client.connected() ||
+             millis() - conn.lastTS > (conn.held ?
+               WEBDUINO_KEEPALIVE_TIMEOUT_IN_MS : WEBDUINO_READ_TIMEOUT_IN_MS))
+    {
+#if WEBDUINO_SERIAL_DEBUGGING
+      Serial.println("*** Connection timed out");
+#endif
+      closeConnection(conn);
+    }
+  }
+}
+
+// take a new client with data in, making room if needed by
+// closing the oldest connection held idle
+void WebServer::acceptConnection()
+{
+  EthernetClient client = m_server.available();
+  if (!client || findConnection(client) != NULL)
+    return;
+
+  EthernetClient none;
+  Connection *conn = findConnection(none);
+  if (conn == NULL)
+  {
+    for (uint8_t i = 0; i < WEBDUINO_MAX_CLIENTS; i++)
+    {
+      if (m_conns[i].held &&
+          (conn == NULL || (long)(m_conns[i].lastTS - conn->lastTS) < 0))
+        conn = &m_conns[i];
+    }
+    if (conn == NULL)
+      return; // left waiting in its socket until a client is done
+    closeConnection(*conn);
+  }
+
+  releaseBuffers(*conn);
+  conn->client = client;
+  conn->held = false;
+  conn->lastTS = millis();
+  startRequest(*conn);
+}
+
+// an empty client finds a free slot
+WebServer::Connection *WebServer::findConnection(EthernetClient &client)
+{
+  for (uint8_t i = 0; i < WEBDUINO_MAX_CLIENTS; i++)
+  {
+    if (client ? m_conns[i].client == client : !m_conns[i].client)
+      return &m_conns[i];
+  }
+  return NULL;
+}
+
+void WebServer::startRequest(Connection &conn)
+{
+  conn.type = INVALID;
+  conn.state = PARSE_METHOD;
+  conn.header = HEADER_OTHER;
+  conn.tokenLen = 0;
+  conn.keepAlive = false;
+  conn.http11 = false;
+  conn.urlLen = 0;
+  conn.contentLength = 0;
+  conn.upgrade = false;
+  if (m_authConn == &conn)
+    m_authConn = NULL;
+#if WEBDUINO_WEBSOCKET
+  conn.webSocketKey[0] = 0;
+#endif
+  conn.ifNoneMatch[0] = 0;
+}
+
+// Consume the bytes available of the request.  Returns true when its
+// headers are complete and the body, if not too big, is in too.
+bool WebServer::parseRequest(Connection &conn)
+{
+  int n = 0;
+  while (n < WEBDUINO_PARSE_BUDGET && conn.state != PARSE_BODY)
+  {
+    if (conn.state == PARSE_HEADER_VALUE &&
+        conn.header == HEADER_AUTHORIZATION && m_authConn != &conn)
+    {
+      // left in the socket until the credentials buffer is free
+      if (m_authConn != NULL)
+        break;
+      m_authConn = &conn;
+      m_authCredentials[0] = 0;
+    }
+    int ch = receive(conn);
+    if (ch == -1)
+      break;
+#if WEBDUINO_SERIAL_DEBUGGING
+    if (ch == '\r')
+      Serial.print("<CR>");
+    else if (ch == '\n')
+      Serial.println("<LF>");
+    else
+      Serial.print((char)ch);
+#endif
+    parseChar(conn, ch);
+    n++;
+  }
+
+  if (n > 0)
+  {
+    conn.held = false;
+    conn.lastTS = millis();
+  }
+
+  if (conn.state != PARSE_BODY)
+    return false;
+
+  return conn.contentLength < 0 ||
+    conn.contentLength > WEBDUINO_MAX_BODY_WAIT ||
+    received(conn) >= conn.contentLength;
+}
+
+// Next byte of the client, read from the socket a buffer at a time
+// when the shared buffer is free
+int WebServer::receive(Connection &conn)
+{
+  if (m_rxPos == m_rxLen)
+  {
+    int n = conn.client.read(m_rx, sizeof(m_rx));
+    if (n <= 0)
+      return -1;
+    m_rxConn = &conn;
+    m_rxPos = 0;
+    m_rxLen = n;
+  }
+  else if (m_rxConn != &conn)
+    return conn.client.read();
+  return m_rx[m_rxPos++];
+}
+
+int WebServer::received(Connection &conn)
+{
+  return (m_rxConn == &conn ? m_rxLen - m_rxPos : 0) +
+    conn.client.available();
+}
+
+void WebServer::parseChar(Connection &conn, char ch)
+{
+  switch (conn.state)
+  {
+  case PARSE_METHOD:
+    if (ch == ' ')
+    {
+      conn.token[conn.tokenLen] = 0;
+      if (strcmp(conn.token, "GET") == 0)
+        conn.type = GET;
+      else if (strcmp(conn.token, "HEAD") == 0)
+        conn.type = HEAD;
+      else if (strcmp(conn.token, "POST") == 0)
+        conn.type = POST;
+      else if (strcmp(conn.token, "PUT") == 0)
+        conn.type = PUT;
+      else if (strcmp(conn.token, "DELETE") == 0)
+        conn.type = DELETE;
+      else if (strcmp(conn.token, "PATCH") == 0)
+        conn.type = PATCH;
+      // don't even look further at unknown methods, the connection
+      // is closed after the failure command
+      conn.state = (conn.type == INVALID) ? PARSE_BODY : PARSE_URL;
+    }
+    else if (ch == '\r' || ch == '\n')
+    {
+      // empty lines before the request line are allowed
+      if (conn.tokenLen > 0)
+        conn.state = PARSE_BODY;
+    }
+    else if (conn.tokenLen < sizeof(conn.token) - 1)
+      conn.token[conn.tokenLen++] = ch;
+    else
+      conn.state = PARSE_BODY;
+    break;
+
+  case PARSE_URL:
+    if (ch == ' ' || ch == '\r' || ch == '\n')
+    {
+      conn.tokenLen = 0;
+      conn.state = (ch == ' ') ? PARSE_VERSION : PARSE_HEADER_NAME;
+    }
+    else
+    {
+      if (conn.urlLen < WEBDUINO_URL_LENGTH - 1)
+        conn.url[conn.urlLen] = ch;
+      // keeps counting, to tell if the URL was cut
+      conn.urlLen++;
+    }
+    break;
+
+  case PARSE_VERSION:
+    if (ch == '\n')
+    {
+      // HTTP/1.1 connections are persistent unless the client
+      // says otherwise, HTTP/1.0 ones only if it asks for it
+      conn.token[conn.tokenLen] = 0;
+      conn.http11 = (strcmp(conn.token, "HTTP/1.1") == 0);
+      conn.keepAlive = conn.http11;
+      conn.tokenLen = 0;
+      conn.state = PARSE_HEADER_NAME;
+    }
+    else if (ch != '\r' && conn.tokenLen < sizeof(conn.token) - 1)
+      conn.token[conn.tokenLen++] = ch;
+    break;
+
+  case PARSE_HEADER_NAME:
+    if (ch == '\n')
+    {
+      // an empty line ends the headers
+      if (conn.tokenLen == 0)
+        conn.state = PARSE_BODY;
+      conn.tokenLen = 0;
+    }
+    else if (ch == ':')
+    {
+      conn.token[conn.tokenLen] = 0;
+      if (strcasecmp(conn.token, "Content-Length") == 0)
+        conn.header = HEADER_CONTENT_LENGTH;
+      else if (strcasecmp(conn.token, "Connection") == 0)
+        conn.header = HEADER_CONNECTION;
+      else if (strcasecmp(conn.token, "Authorization") == 0)
+        conn.header = HEADER_AUTHORIZATION;
+      else if (strcasecmp(conn.token, "Upgrade") == 0)
+        conn.header = HEADER_UPGRADE;
+#if WEBDUINO_WEBSOCKET
+      else if (strcasecmp(conn.token, "Sec-WebSocket-Key") == 0)
+        conn.header = HEADER_WEBSOCKET_KEY;
+#endif
+      else if (strcasecmp(conn.token, "If-None-Match") == 0)
+        conn.header = HEADER_IF_NONE_MATCH;
+      else
+        conn.header = HEADER_OTHER;
+      conn.tokenLen = 0;
+      conn.state = PARSE_HEADER_VALUE;
+    }
+    else if (ch != '\r' && conn.tokenLen < sizeof(conn.token) - 1)
+      conn.token[conn.tokenLen++] = ch;
+    break;
+
+  case PARSE_HEADER_VALUE:
+    if (ch == '\n')
+    {
+      endHeader(conn);
+      conn.tokenLen = 0;
+      conn.state = PARSE_HEADER_NAME;
+    }
+    else if (ch == '\r' || (conn.tokenLen == 0 && (ch == ' ' || ch == '\t')))
+    {
+      // absorb whitespace in front
+    }
+    else if (conn.header == HEADER_CONTENT_LENGTH)
+    {
+      // stays negative once found out of range or malformed
+      if (conn.contentLength >= 0)
+      {
+        int digit = ch - '0';
+        if (digit < 0 || digit > 9)
+          conn.contentLength = CONTENT_LENGTH_INVALID;
+        else if (conn.contentLength >
+                 (WEBDUINO_MAX_CONTENT_LENGTH - digit) / 10)
+          conn.contentLength = CONTENT_LENGTH_TOO_LARGE;
+        else
+          conn.contentLength = conn.contentLength * 10 + digit;
+      }
+      conn.tokenLen = 1;
+    }
+    else if (conn.header == HEADER_CONNECTION ||
+             conn.header == HEADER_UPGRADE)
+    {
+      if (conn.tokenLen < sizeof(conn.token) - 1)
+        conn.token[conn.tokenLen++] = ch;
+    }
+    else if (conn.header == HEADER_AUTHORIZATION)
+    {
+      if (conn.tokenLen < sizeof(m_authCredentials) - 1)
+        m_authCredentials[conn.tokenLen++] = ch;
+    }
+#if WEBDUINO_WEBSOCKET
+    else if (conn.header == HEADER_WEBSOCKET_KEY)
+    {
+      if (conn.tokenLen < sizeof(conn.webSocketKey) - 1)
+        conn.webSocketKey[conn.tokenLen++] = ch;
+    }
+#endif
+    else if (conn.header == HEADER_IF_NONE_MATCH)
+    {
+      // one past the end when too long, cut off by endHeader()
+      if (conn.tokenLen < sizeof(conn.ifNoneMatch))
+        conn.ifNoneMatch[conn.tokenLen++] = ch;
+    }
+    else
+      conn.tokenLen = 1;
+    break;
+  }
+}
+
+void WebServer::endHeader(Connection &conn)
+{
+  switch (conn.header)
+  {
+  case HEADER_CONTENT_LENGTH:
+#if WEBDUINO_SERIAL_DEBUGGING > 1
+    Serial.print("\n*** got Content-Length of ");
+    Serial.print(conn.contentLength);
+    Serial.print(" ***");
+#endif
+    break;
+
+  case HEADER_CONNECTION:
+    conn.token[conn.tokenLen] = 0;
+    if (strncasecmp(conn.token, "keep-alive", 10) == 0)
+      conn.keepAlive = true;
+    else if (strncasecmp(conn.token, "close", 5) == 0)
+      conn.keepAlive = false;
+    break;
+
+  case HEADER_AUTHORIZATION:
+    m_authCredentials[conn.tokenLen] = 0;
+#if WEBDUINO_SERIAL_DEBUGGING > 1
+    Serial.print("\n*** got Authorization: of ");
+    Serial.print(m_authCredentials);
+    Serial.print(" ***");
+#endif
+    break;
+
+  case HEADER_UPGRADE:
+    conn.token[conn.tokenLen] = 0;
+    conn.upgrade = (strcasecmp(conn.token, "websocket") == 0);
+    break;
+
+#if WEBDUINO_WEBSOCKET
+  case HEADER_WEBSOCKET_KEY:
+    conn.webSocketKey[conn.tokenLen] = 0;
+    break;
+#endif
+
+  case HEADER_IF_NONE_MATCH:
+    conn.ifNoneMatch[conn.tokenLen < sizeof(conn.ifNoneMatch) ?
+                     conn.tokenLen : 0] = 0;
+    break;
+  }
+}
 
-  m_client = m_server.available();
+void WebServer::serveRequest(Connection &conn, char *buff, int size,
+                             int *bufflen)
+{
+  int urlPrefixLen = strlen(m_urlPrefix);
+  IONO_METRIC_INC(httpRequests);
+
+  // the URL is copied in buff, up to the length passed in size.  On
+  // return bufflen contains the amount of space left in buff.  If it's
+  // less than 0,  the URL was longer than the buffer,  and part of it
+  // had to be discarded.
+  int len = conn.urlLen < WEBDUINO_URL_LENGTH - 1 ?
+    conn.urlLen : WEBDUINO_URL_LENGTH - 1;
+  if (len > size - 1)
+    len = size - 1;
+  memcpy(buff, conn.url, len);
+  buff[len] = 0;
+  *bufflen = size - 1 - conn.urlLen;
+  if (conn.urlLen > WEBDUINO_URL_LENGTH - 1 && *bufflen >= 0)
+    *bufflen = -1;
+
+  m_conn = &conn;
+  m_client = conn.client;
+  m_pushbackDepth = 0;
+  m_contentLength = conn.contentLength;
+  // can't tell where the next request starts if the body is not all in
+  m_keepAlive = conn.keepAlive &&
+    received(conn) >= conn.contentLength;
+  m_chunked = false;
+  m_chunkSent = false;
+  m_persist = false;
+  m_stream = false;
+  m_webSocket = false;
+  ConnectionType requestType = conn.type;
 
-  if (m_client) {
-    m_readingContent = false;
-    buff[0] = 0;
-    ConnectionType requestType = INVALID;
 #if WEBDUINO_SERIAL_DEBUGGING > 1
-    Serial.println("*** checking request ***");
+  Serial.print("*** requestType = ");
+  Serial.print((int)requestType);
+  Serial.print(", request = \"");
+  Serial.print(buff);
+  Serial.println("\" ***");
 #endif
-    getRequest(requestType, buff, bufflen);
+
+  if (conn.contentLength < 0)
+  {
+    // without a usable length the body can't be skipped, so the
+    // connection is closed after the answer
+    m_keepAlive = false;
+    m_contentLength = 0;
+    if (conn.contentLength == CONTENT_LENGTH_TOO_LARGE)
+      httpPayloadTooLarge();
+    else
+      httpFail();
+  }
+  else
+  {
+    if (requestType != INVALID)
+    {
+      if (strcmp(buff, "/robots.txt") == 0)
+      {
+        noRobots(requestType);
+      }
+      else if (strcmp(buff, "/favicon.ico") == 0)
+      {
+        favicon(requestType);
+      }
+    }
+    // Only try to dispatch command if request type and prefix are correct.
+    // Fix by quarencia.
+    if (requestType == INVALID ||
+        strncmp(buff, m_urlPrefix, urlPrefixLen) != 0)
+    {
+      m_failureCmd(*this, requestType, buff, (*bufflen) >= 0);
+    }
+    else if (!dispatchCommand(requestType, buff + urlPrefixLen,
+             (*bufflen) >= 0))
+    {
+      m_failureCmd(*this, requestType, buff, (*bufflen) >= 0);
+    }
+  }
+
+  endChunked();
+  flushBuf();
+
+  if (m_authConn == &conn)
+    m_authConn = NULL;
+
+  if (!m_client)
+  {
+    // closed by the command
+    releaseBuffers(conn);
+    conn.client = EthernetClient();
+  }
+  else if (m_stream)
+  {
+    while (m_contentLength > 0 && read() != -1);
+    conn.state = STREAMING;
+  }
+  else if (m_webSocket)
+  {
+    while (m_contentLength > 0 && read() != -1);
+    conn.state = WEBSOCKET;
+    conn.header = 0;
+    conn.tokenLen = 0;
+    conn.opcode = 0;
+    conn.urlLen = 0;
+  }
+  else if (m_persist)
+  {
+    // skip what the command has not read of the body, so
+    // that the next request starts at the right place
+    while (m_contentLength > 0 && read() != -1);
+    conn.held = true;
+    conn.lastTS = millis();
+    startRequest(conn);
+  }
+  else
+  {
 #if WEBDUINO_SERIAL_DEBUGGING > 1
-    Serial.print("*** requestType = ");
-    Serial.print((int)requestType);
-    Serial.print(", request = \"");
-    Serial.print(buff);
-    Serial.println("\" ***");
+    Serial.println("*** stopping connection ***");
 #endif
+    closeConnection(conn);
+  }
+
+  m_client = EthernetClient();
+  m_conn = NULL;
+  m_pushbackDepth = 0;
+}
+
+void WebServer::closeConnection(Connection &conn)
+{
+  releaseBuffers(conn);
+  conn.client.flush();
+  conn.client.stop();
+  conn.client = EthernetClient();
+  conn.held = false;
+}
+
+// drops what the client holds of the shared buffers
+void WebServer::releaseBuffers(Connection &conn)
+{
+  if (m_rxConn == &conn)
+  {
+    m_rxConn = NULL;
+    m_rxPos = m_rxLen = 0;
+  }
+  if (m_authConn == &conn)
+    m_authConn = NULL;
+}
+
+// With a known length the connection can stay open if the client
+// asked for it and a keep-alive slot is free
+void WebServer::printConnectionHeaders(long contentLength)
+{
+  if (contentLength < 0)
+    return;
+
+  P(contentLengthMsg) = "Content-Length: ";
+  printP(contentLengthMsg);
+  print(contentLength);
+  printCRLF();
+  printKeepAlive();
+}
+
+void WebServer::printKeepAlive()
+{
+  if (!m_keepAlive)
+    return;
+
+  uint8_t held = 0;
+  for (uint8_t i = 0; i < WEBDUINO_MAX_CLIENTS; i++)
+  {
+    if (m_conns[i].client && m_conns[i].held)
+      held++;
+  }
+
+  if (held < WEBDUINO_MAX_KEEPALIVE)
+  {
+    P(keepAliveMsg) = "Connection: keep-alive" CRLF;
+    printP(keepAliveMsg);
+    m_persist = true;
+  }
+  else
+  {
+    P(closeMsg) = "Connection: close" CRLF;
+    printP(closeMsg);
+  }
+}
+
+bool WebServer::checkCredentials(const char authCredentials[45])
+{
+  char basic[7] = "Basic ";
+  if (m_conn == NULL || m_authConn != m_conn)
+    return false;
+  if((0 == strncmp(m_authCredentials,basic,6)) &&
+     (0 == strcmp(authCredentials, m_authCredentials + 6))) return true;
+  return false;
+}
+
+const char *WebServer::ifNoneMatch()
+{
+  return m_conn != NULL ? m_conn->ifNoneMatch : "";
+}
+
+// A list of tags, weak ones included, is matched as long as
+// it fits in the header buffer
+bool WebServer::etagMatches(const char *etag)
+{
+  const char *header = ifNoneMatch();
+  if (header[0] == 0)
+    return false;
+  if (strcmp(header, "*") == 0)
+    return true;
+  return strstr(header, etag) != NULL;
+}
+
+void WebServer::httpFail()
+{
+  P(failMsg1) = "HTTP/1.0 400 Bad Request" CRLF;
+  printP(failMsg1);
+
+#ifndef WEBDUINO_SUPRESS_SERVER_HEADER
+  printP(webServerHeader);
+#endif
+
+  P(failMsg2) = "Content-Type: text/html" CRLF;
+  printP(failMsg2);
+  printConnectionHeaders(sizeof(WEBDUINO_FAIL_MESSAGE) - 1);
+
+  P(failMsg3) =
+    CRLF
+    WEBDUINO_FAIL_MESSAGE;
+
+  printP(failMsg3);
+}
+
+void WebServer::httpPayloadTooLarge()
+{
+  P(tooLargeMsg1) = "HTTP/1.0 413 Payload Too Large" CRLF;
+  printP(tooLargeMsg1);
+
+#ifndef WEBDUINO_SUPRESS_SERVER_HEADER
+  printP(webServerHeader);
+#endif
+
+  P(failMsg2) = "Content-Type: text/html" CRLF;
+  printP(failMsg2);
+  printConnectionHeaders(sizeof(WEBDUINO_FAIL_MESSAGE) - 1);
+
+  P(failMsg3) =
+    CRLF
+    WEBDUINO_FAIL_MESSAGE;
+
+  printP(failMsg3);
+}
+
+void WebServer::httpMethodNotAllowed(uint8_t methods)
+{
+  P(notAllowedMsg1) = "HTTP/1.0 405 Method Not Allowed" CRLF;
+  printP(notAllowedMsg1);
+
+#ifndef WEBDUINO_SUPRESS_SERVER_HEADER
+  printP(webServerHeader);
+#endif
+
+  static const char *const names[] = { "GET", "HEAD", "POST", "PUT", "DELETE", "PATCH" };
+  P(allowMsg) = "Allow: ";
+  printP(allowMsg);
+  const char *sep = "";
+  for (uint8_t i = GET; i <= PATCH; i++)
+  {
+    if (methods & (1 << i))
+    {
+      print(sep);
+      print(names[i - GET]);
+      sep = ", ";
+    }
+  }
+  printCRLF();
+
+  P(failMsg2) = "Content-Type: text/html" CRLF;
+  printP(failMsg2);
+  printConnectionHeaders(sizeof(WEBDUINO_FAIL_MESSAGE) - 1);
+
+  P(failMsg3) =
+    CRLF
+    WEBDUINO_FAIL_MESSAGE;
+
+  printP(failMsg3);
+}
+
+void WebServer::defaultFailCmd(WebServer &server,
+                               WebServer::ConnectionType type,
+                               char *url_tail,
+                               bool tail_complete)
+{
+  server.httpFail();
+}
+
+void WebServer::noRobots(ConnectionType type)
+{
+  httpSuccess("text/plain");
+  if (type != HEAD)
+  {
+    P(allowNoneMsg) = "User-agent: *" CRLF "Disallow: /" CRLF;
+    printP(allowNoneMsg);
+  }
+}
+
+void WebServer::favicon(ConnectionType type)
+{
+  httpSuccess("image/x-icon","Cache-Control: max-age=31536000\r\n");
+  if (type != HEAD)
+  {
+    P(faviconIco) = WEBDUINO_FAVICON_DATA;
+    writeP(faviconIco, sizeof(faviconIco));
+  }
+}
+
+// void WebServer::httpUnauthorized()
+// {
+//   P(unauthMsg1) = "HTTP/1.0 401 Authorization Required" CRLF;
+//   printP(unauthMsg1);
+
+// #ifndef WEBDUINO_SUPRESS_SERVER_HEADER
+//   printP(webServerHeader);
+// #endif
+
+//   P(unauthMsg2) =
+//     "Content-Type: text/html" CRLF
+//     "WWW-Authenticate: Basic realm=\"" WEBDUINO_AUTH_REALM "\"" CRLF
+//     CRLF
+//     WEBDUINO_AUTH_MESSAGE;
+
+//   printP(unauthMsg2);
+// }
+
+// void WebServer::httpServerError()
+// {
+//   P(servErrMsg1) = "HTTP/1.0 500 Internal Server Error" CRLF;
+//   printP(servErrMsg1);
+
+// #ifndef WEBDUINO_SUPRESS_SERVER_HEADER
+//   printP(webServerHeader);
+// #endif
+
+//   P(servErrMsg2) =
+//     "Content-Type: text/html" CRLF
+//     CRLF
+//     WEBDUINO_SERVER_ERROR_MESSAGE;
+
+//   printP(servErrMsg2);
+// }
+
+// void WebServer::httpNoContent()
+// {
+//   P(noContentMsg1) = "HTTP/1.0 204 NO CONTENT" CRLF;
+//   printP(noContentMsg1);
+
+// #ifndef WEBDUINO_SUPRESS_SERVER_HEADER
+//   printP(webServerHeader);
+// #endif
+
+//   P(noContentMsg2) =
+//     CRLF
+//     CRLF;
+
+//   printP(noContentMsg2);
+// }
+
+// No body, so the connection can be kept without a Content-Length
+void WebServer::httpNotModified(const char *etag)
+{
+  P(notModifiedMsg) = "HTTP/1.0 304 Not Modified" CRLF;
+  printP(notModifiedMsg);
+
+#ifndef WEBDUINO_SUPRESS_SERVER_HEADER
+  printP(webServerHeader);
+#endif
+
+  P(etagMsg) = "ETag: ";
+  printP(etagMsg);
+  print(etag);
+  printCRLF();
+  printKeepAlive();
+  printCRLF();
+}
+
+void WebServer::httpSuccess(const char *contentType,
+                            const char *extraHeaders)
+{
+  httpSuccess(contentType, extraHeaders, -1);
+}
+
+void WebServer::httpSuccess(const char *contentType,
+                            const char *extraHeaders,
+                            long contentLength)
+{
+  P(successMsg1) = "HTTP/1.0 200 OK" CRLF;
+  printP(successMsg1);
+
+#ifndef WEBDUINO_SUPRESS_SERVER_HEADER
+  printP(webServerHeader);
+#endif
+
+  P(successMsg2) =
+    "Access-Control-Allow-Origin: *" CRLF
+    "Content-Type: ";
+
+  printP(successMsg2);
+  print(contentType);
+  printCRLF();
+  printConnectionHeaders(contentLength);
+  if (extraHeaders)
+    print(extraHeaders);
+  printCRLF();
+}
+
+// The status line says HTTP/1.1 as chunks are not allowed in 1.0.
+// Nothing is framed for a HEAD request, it gets the headers only
+void WebServer::beginChunked(const char *contentType,
+                             const char *extraHeaders)
+{
+  if (m_conn == NULL || !m_conn->http11)
+  {
+    httpSuccess(contentType, extraHeaders);
+    return;
+  }
+
+  P(chunkedMsg1) = "HTTP/1.1 200 OK" CRLF;
+  printP(chunkedMsg1);
+
+#ifndef WEBDUINO_SUPRESS_SERVER_HEADER
+  printP(webServerHeader);
+#endif
+
+  P(chunkedMsg2) =
+    "Access-Control-Allow-Origin: *" CRLF
+    "Content-Type: ";
+
+  printP(chunkedMsg2);
+  print(contentType);
+  printCRLF();
+  P(chunkedMsg3) = "Transfer-Encoding: chunked" CRLF;
+  printP(chunkedMsg3);
+  printKeepAlive();
+  if (extraHeaders)
+    print(extraHeaders);
+  printCRLF();
+
+  if (m_conn->type != HEAD)
+  {
+    flushBuf();
+    m_chunked = true;
+    m_chunkSent = false;
+  }
+}
+
+void WebServer::endChunked()
+{
+  if (!m_chunked)
+    return;
+
+  flushBuf();
+  m_chunked = false;
+  P(lastChunkMsg) = CRLF "0" CRLF CRLF;
+  if (m_chunkSent)
+    printP(lastChunkMsg);
+  else
+    printP(lastChunkMsg + 2);
+}
+
+bool WebServer::httpEventStream()
+{
+  if (m_conn == NULL ||
+      streamCount() + webSocketCount() >= WEBDUINO_MAX_CLIENTS - 1)
+    return false;
+
+  P(eventStreamMsg1) = "HTTP/1.0 200 OK" CRLF;
+  printP(eventStreamMsg1);
+
+#ifndef WEBDUINO_SUPRESS_SERVER_HEADER
+  printP(webServerHeader);
+#endif
+
+  P(eventStreamMsg2) =
+    "Access-Control-Allow-Origin: *" CRLF
+    "Content-Type: text/event-stream" CRLF
+    "Cache-Control: no-cache" CRLF
+    CRLF;
+
+  printP(eventStreamMsg2);
+  m_stream = true;
+  return true;
+}
+
+void WebServer::writeStreams(const uint8_t *buffer, size_t size)
+{
+  for (uint8_t i = 0; i < WEBDUINO_MAX_CLIENTS; i++)
+  {
+    if (m_conns[i].client && m_conns[i].state == STREAMING)
+      m_conns[i].client.write(buffer, size);
+  }
+}
+
+uint8_t WebServer::streamCount()
+{
+  return countConnections(STREAMING);
+}
+
+uint8_t WebServer::clientCount()
+{
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < WEBDUINO_MAX_CLIENTS; i++)
+  {
+    if (m_conns[i].client)
+      count++;
+  }
+  return count;
+}
+
+uint8_t WebServer::countConnections(uint8_t state)
+{
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < WEBDUINO_MAX_CLIENTS; i++)
+  {
+    if (m_conns[i].client && m_conns[i].state == state)
+      count++;
+  }
+  return count;
+}
 
-    // don't even look further at invalid requests.
-    // this is done to prevent Webduino from hanging
-    // - when there are illegal requests,
-    // - when someone contacts it through telnet rather than proper HTTP,
-    // - etc.
-    if (requestType != INVALID)
+#if WEBDUINO_WEBSOCKET
+// SHA-1 of a message shorter than 120 bytes
+static void sha1(const uint8_t *data, uint8_t length, uint8_t *hash)
+{
+  uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                    0xC3D2E1F0 };
+  uint8_t blocks = (length + 8) / 64 + 1;
+
+  for (uint8_t blk = 0; blk < blocks; blk++)
+  {
+    // the message, 0x80 and its length in bits at the end of the last block
+    uint32_t w[16];
+    for (uint8_t i = 0; i < 64; i++)
     {
-      processHeaders();
-#if WEBDUINO_SERIAL_DEBUGGING > 1
-      Serial.println("*** headers complete ***");
-#endif
+      uint16_t pos = blk * 64 + i;
+      uint8_t byte = 0;
+      if (pos < length)
+        byte = data[pos];
+      else if (pos == length)
+        byte = 0x80;
+      else if (blk == blocks - 1 && i >= 60)
+        byte = ((uint32_t)length * 8) >> (8 * (63 - i));
+      w[i / 4] = (w[i / 4] << 8) | byte;
+    }
 
-      if (strcmp(buff, "/robots.txt") == 0)
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (uint8_t i = 0; i < 80; i++)
+    {
+      if (i >= 16)
       {
-        noRobots(requestType);
+        uint32_t x = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^
+                     w[i & 15];
+        w[i & 15] = (x << 1) | (x >> 31);
       }
-      else if (strcmp(buff, "/favicon.ico") == 0)
+      uint32_t f, k;
+      if (i < 20)
       {
-        favicon(requestType);
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
       }
+      else if (i < 40)
+      {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      }
+      else if (i < 60)
+      {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      }
+      else
+      {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t t = ((a << 5) | (a >> 27)) + f + e + k + w[i & 15];
+      e = d;
+      d = c;
+      c = (b << 30) | (b >> 2);
+      b = a;
+      a = t;
     }
-    // Only try to dispatch command if request type and prefix are correct.
-    // Fix by quarencia.
-    if (requestType == INVALID ||
-        strncmp(buff, m_urlPrefix, urlPrefixLen) != 0)
-    {
-      m_failureCmd(*this, requestType, buff, (*bufflen) >= 0);
-    }
-    else if (!dispatchCommand(requestType, buff + urlPrefixLen,
-             (*bufflen) >= 0))
-    {
-      m_failureCmd(*this, requestType, buff, (*bufflen) >= 0);
-    }
-
-    flushBuf();
-
-#if WEBDUINO_SERIAL_DEBUGGING > 1
-    Serial.println("*** stopping connection ***");
-#endif
-    reset();
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
   }
-}
 
-bool WebServer::checkCredentials(const char authCredentials[45])
-{
-  char basic[7] = "Basic ";
-  if((0 == strncmp(m_authCredentials,basic,6)) &&
-     (0 == strcmp(authCredentials, m_authCredentials + 6))) return true;
-  return false;
+  for (uint8_t i = 0; i < 20; i++)
+    hash[i] = h[i / 4] >> (24 - 8 * (i % 4));
 }
 
-void WebServer::httpFail()
+static void base64(const uint8_t *data, uint8_t length, char *out)
 {
-  P(failMsg1) = "HTTP/1.0 400 Bad Request" CRLF;
-  printP(failMsg1);
+  P(base64Chars) =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-#ifndef WEBDUINO_SUPRESS_SERVER_HEADER
-  printP(webServerHeader);
+  for (uint8_t i = 0; i < length; i += 3)
+  {
+    uint32_t v = (uint32_t)data[i] << 16;
+    if (i + 1 < length)
+      v |= (uint32_t)data[i + 1] << 8;
+    if (i + 2 < length)
+      v |= data[i + 2];
+    *out++ = pgm_read_byte(base64Chars + ((v >> 18) & 63));
+    *out++ = pgm_read_byte(base64Chars + ((v >> 12) & 63));
+    *out++ = i + 1 < length ? pgm_read_byte(base64Chars + ((v >> 6) & 63)) : '=';
+    *out++ = i + 2 < length ? pgm_read_byte(base64Chars + (v & 63)) : '=';
+  }
+  *out = 0;
+}
 #endif
 
-  P(failMsg2) =
-    "Content-Type: text/html" CRLF
-    CRLF
-    WEBDUINO_FAIL_MESSAGE;
+bool WebServer::httpWebSocket()
+{
+#if WEBDUINO_WEBSOCKET
+  if (m_conn == NULL || !m_conn->upgrade ||
+      strlen(m_conn->webSocketKey) != 24 ||
+      streamCount() + webSocketCount() >= WEBDUINO_MAX_CLIENTS - 1)
+    return false;
 
-  printP(failMsg2);
+  // Sec-WebSocket-Accept is the base64 SHA-1 of the key and the GUID
+  uint8_t buff[60];
+  memcpy(buff, m_conn->webSocketKey, 24);
+  memcpy(buff + 24, "258EAFA5-E914-47DA-95CA-C5AB0DC85B11", 36);
+  sha1(buff, 60, buff);
+  char accept[29];
+  base64(buff, 20, accept);
+
+  P(webSocketMsg) =
+    "HTTP/1.1 101 Switching Protocols" CRLF
+    "Upgrade: websocket" CRLF
+    "Connection: Upgrade" CRLF
+    "Sec-WebSocket-Accept: ";
+
+  printP(webSocketMsg);
+  print(accept);
+  printCRLF();
+  printCRLF();
+  m_webSocket = true;
+  return true;
+#else
+  return false;
+#endif
 }
 
-void WebServer::defaultFailCmd(WebServer &server,
-                               WebServer::ConnectionType type,
-                               char *url_tail,
-                               bool tail_complete)
+void WebServer::writeWebSocket(const uint8_t *data, size_t length,
+                               bool binary)
 {
-  server.httpFail();
+  writeFrame(binary ? 0x2 : 0x1, data, length);
 }
 
-void WebServer::noRobots(ConnectionType type)
+void WebServer::broadcastWebSocket(const uint8_t *data, size_t length,
+                                   bool binary)
 {
-  httpSuccess("text/plain");
-  if (type != HEAD)
+  flushBuf();
+  EthernetClient current = m_client;
+  for (uint8_t i = 0; i < WEBDUINO_MAX_CLIENTS; i++)
   {
-    P(allowNoneMsg) = "User-agent: *" CRLF "Disallow: /" CRLF;
-    printP(allowNoneMsg);
+    if (m_conns[i].client && m_conns[i].state == WEBSOCKET)
+    {
+      m_client = m_conns[i].client;
+      writeWebSocket(data, length, binary);
+    }
   }
+  m_client = current;
 }
 
-void WebServer::favicon(ConnectionType type)
+uint8_t WebServer::webSocketCount()
 {
-  httpSuccess("image/x-icon","Cache-Control: max-age=31536000\r\n");
-  if (type != HEAD)
+  return countConnections(WEBSOCKET);
+}
+
+// server frames are not masked
+void WebServer::writeFrame(uint8_t opcode, const uint8_t *data,
+                           size_t length)
+{
+  write(0x80 | opcode);
+  if (length < 126)
   {
-    P(faviconIco) = WEBDUINO_FAVICON_DATA;
-    writeP(faviconIco, sizeof(faviconIco));
+    write(length);
+  }
+  else
+  {
+    write(126);
+    write(length >> 8);
+    write(length & 0xff);
   }
+  write(data, length);
+  flushBuf();
 }
 
-// void WebServer::httpUnauthorized()
-// {
-//   P(unauthMsg1) = "HTTP/1.0 401 Authorization Required" CRLF;
-//   printP(unauthMsg1);
-
-// #ifndef WEBDUINO_SUPRESS_SERVER_HEADER
-//   printP(webServerHeader);
-// #endif
-
-//   P(unauthMsg2) =
-//     "Content-Type: text/html" CRLF
-//     "WWW-Authenticate: Basic realm=\"" WEBDUINO_AUTH_REALM "\"" CRLF
-//     CRLF
-//     WEBDUINO_AUTH_MESSAGE;
-
-//   printP(unauthMsg2);
-// }
-
-// void WebServer::httpServerError()
-// {
-//   P(servErrMsg1) = "HTTP/1.0 500 Internal Server Error" CRLF;
-//   printP(servErrMsg1);
+void WebServer::closeWebSocket(Connection &conn, uint16_t status)
+{
+  uint8_t payload[2] = { (uint8_t)(status >> 8), (uint8_t)(status & 0xff) };
+  m_client = conn.client;
+  writeFrame(0x8, payload, sizeof(payload));
+  m_client = EthernetClient();
+  closeConnection(conn);
+}
 
-// #ifndef WEBDUINO_SUPRESS_SERVER_HEADER
-//   printP(webServerHeader);
-// #endif
+// Consume the bytes available of the frames coming in.  Fragments are
+// put together in url, control frames can come in between.
+void WebServer::parseWebSocket(Connection &conn)
+{
+  for (int n = 0; n < WEBDUINO_PARSE_BUDGET && conn.client; n++)
+  {
+    int ch = receive(conn);
+    if (ch == -1)
+      break;
 
-//   P(servErrMsg2) =
-//     "Content-Type: text/html" CRLF
-//     CRLF
-//     WEBDUINO_SERVER_ERROR_MESSAGE;
+    if (conn.header == 0 || conn.tokenLen < conn.header)
+    {
+      conn.token[conn.tokenLen++] = ch;
+      if (conn.tokenLen == 2)
+      {
+        uint8_t len = conn.token[1] & 0x7f;
+        conn.header = 2 + (len == 126 ? 2 : len == 127 ? 8 : 0) +
+                      ((conn.token[1] & 0x80) ? 4 : 0);
+      }
+      if (conn.tokenLen == conn.header && !startFrame(conn))
+        return;
+    }
+    else
+    {
+      // unmask the payload
+      ch ^= (uint8_t)conn.token[conn.header - 4 + (conn.framePos & 3)];
+      if ((conn.token[0] & 0x0f) < 0x8)
+        conn.url[conn.urlLen++] = ch;
+      else
+        conn.url[conn.urlLen + conn.framePos] = ch;
+      conn.framePos++;
+      if (conn.framePos == conn.contentLength && !endFrame(conn))
+        return;
+    }
+  }
+}
 
-//   printP(servErrMsg2);
-// }
+bool WebServer::startFrame(Connection &conn)
+{
+  uint8_t opcode = conn.token[0] & 0x0f;
+  uint8_t len = conn.token[1] & 0x7f;
+  unsigned long length = len;
+  bool tooBig = false;
 
-// void WebServer::httpNoContent()
-// {
-//   P(noContentMsg1) = "HTTP/1.0 204 NO CONTENT" CRLF;
-//   printP(noContentMsg1);
+  if (len == 126)
+  {
+    length = ((uint16_t)(uint8_t)conn.token[2] << 8) | (uint8_t)conn.token[3];
+  }
+  else if (len == 127)
+  {
+    length = 0;
+    for (uint8_t i = 2; i < 10; i++)
+    {
+      if (length > 0xffffff)
+        tooBig = true;
+      length = (length << 8) | (uint8_t)conn.token[i];
+    }
+  }
 
-// #ifndef WEBDUINO_SUPRESS_SERVER_HEADER
-//   printP(webServerHeader);
-// #endif
+  // client frames must be masked, control frames can't be fragmented
+  // and a continuation must follow a fragment
+  if (!(conn.token[1] & 0x80) ||
+      (opcode >= 0x8 && (!(conn.token[0] & 0x80) || len > 125)) ||
+      (opcode == 0x0 && conn.opcode == 0) ||
+      ((opcode == 0x1 || opcode == 0x2) && conn.opcode != 0))
+  {
+    closeWebSocket(conn, 1002);
+    return false;
+  }
 
-//   P(noContentMsg2) =
-//     CRLF
-//     CRLF;
+  // messages, and control frames after them, must fit in url
+  if (tooBig || conn.urlLen + length > WEBDUINO_URL_LENGTH - 1)
+  {
+    closeWebSocket(conn, 1009);
+    return false;
+  }
 
-//   printP(noContentMsg2);
-// }
+  if (opcode == 0x1 || opcode == 0x2)
+    conn.opcode = opcode;
+  conn.contentLength = length;
+  conn.framePos = 0;
+  return length > 0 || endFrame(conn);
+}
 
-void WebServer::httpSuccess(const char *contentType,
-                            const char *extraHeaders)
+bool WebServer::endFrame(Connection &conn)
 {
-  P(successMsg1) = "HTTP/1.0 200 OK" CRLF;
-  printP(successMsg1);
+  uint8_t opcode = conn.token[0] & 0x0f;
+  bool fin = conn.token[0] & 0x80;
+  uint8_t *payload = (uint8_t *)conn.url + conn.urlLen;
+  conn.header = 0;
+  conn.tokenLen = 0;
 
-#ifndef WEBDUINO_SUPRESS_SERVER_HEADER
-  printP(webServerHeader);
-#endif
+  switch (opcode)
+  {
+  case 0x0:
+  case 0x1:
+  case 0x2:
+    if (fin)
+    {
+      conn.url[conn.urlLen] = 0;
+      if (m_webSocketCmd != NULL)
+      {
+        m_conn = &conn;
+        m_client = conn.client;
+        m_webSocketCmd(*this, conn.url, conn.urlLen, conn.opcode == 0x2);
+        flushBuf();
+        if (!m_client)
+          conn.client = EthernetClient();
+        m_client = EthernetClient();
+        m_conn = NULL;
+      }
+      conn.urlLen = 0;
+      conn.opcode = 0;
+    }
+    return conn.client;
+
+  case 0x8:
+    // echo the status code and close
+    m_client = conn.client;
+    writeFrame(0x8, payload, conn.contentLength < 2 ? conn.contentLength : 2);
+    m_client = EthernetClient();
+    closeConnection(conn);
+    return false;
 
-  P(successMsg2) =
-    "Access-Control-Allow-Origin: *" CRLF
-    "Content-Type: ";
+  case 0x9:
+    m_client = conn.client;
+    writeFrame(0xA, payload, conn.contentLength);
+    m_client = EthernetClient();
+    return true;
 
-  printP(successMsg2);
-  print(contentType);
-  printCRLF();
-  if (extraHeaders)
-    print(extraHeaders);
-  printCRLF();
+  case 0xA:
+    return true;
+  }
+
+  closeWebSocket(conn, 1002);
+  return false;
 }
 
 void WebServer::httpSeeOther(const char *otherURL)
@@ -450,71 +1701,46 @@ int WebServer::read()
   if (!m_client)
     return -1;
 
-  if (m_pushbackDepth == 0)
-  {
-    unsigned long timeoutTime = millis() + WEBDUINO_READ_TIMEOUT_IN_MS;
+  if (m_pushbackDepth > 0)
+    return m_pushback[--m_pushbackDepth];
 
-    while (m_client.connected())
-    {
-      // stop reading the socket early if we get to content-length
-      // characters in the POST.  This is because some clients leave
-      // the socket open because they assume HTTP keep-alive.
-      if (m_readingContent)
-      {
-        if (m_contentLength == 0)
-        {
+  // stop reading the socket at content-length characters, what
+  // follows is the next request of a persistent connection
+  if (m_contentLength <= 0)
+  {
 #if WEBDUINO_SERIAL_DEBUGGING > 1
-          Serial.println("\n*** End of content, terminating connection");
+    Serial.println("\n*** End of content");
 #endif
-          return -1;
-        }
-      }
-
-      int ch = m_client.read();
-
-      // if we get a character, return it, otherwise continue in while
-      // loop, checking connection status
-      if (ch != -1)
-      {
-        // count character against content-length
-        if (m_readingContent)
-        {
-          --m_contentLength;
-        }
+    return -1;
+  }
 
-#if WEBDUINO_SERIAL_DEBUGGING
-        if (ch == '\r')
-          Serial.print("<CR>");
-        else if (ch == '\n')
-          Serial.println("<LF>");
-        else
-          Serial.print((char)ch);
-#endif
-        return ch;
-      }
-      else
-      {
-        unsigned long now = millis();
-        if (now > timeoutTime)
-        {
-          // connection timed out, destroy client, return EOF
-#if WEBDUINO_SERIAL_DEBUGGING
-          Serial.println("*** Connection timed out");
-#endif
-          reset();
-          return -1;
-        }
-      }
-    }
+  // bodies up to WEBDUINO_MAX_BODY_WAIT have been waited for before
+  // running the command, longer ones are waited for here as they
+  // come in, up to the read timeout
+  int ch = (m_conn != NULL) ? receive(*m_conn) : m_client.read();
+  if (ch == -1 && m_conn != NULL &&
+      m_conn->contentLength > WEBDUINO_MAX_BODY_WAIT)
+  {
+    unsigned long ts = millis();
+    while (ch == -1 && m_client.connected() &&
+           millis() - ts < WEBDUINO_READ_TIMEOUT_IN_MS)
+      ch = receive(*m_conn);
+  }
+  if (ch != -1)
+  {
+    // count character against content-length
+    --m_contentLength;
 
-    // connection lost, return EOF
 #if WEBDUINO_SERIAL_DEBUGGING
-    Serial.println("*** Connection lost");
+    if (ch == '\r')
+      Serial.print("<CR>");
+    else if (ch == '\n')
+      Serial.println("<LF>");
+    else
+      Serial.print((char)ch);
 #endif
-    return -1;
   }
-  else
-    return m_pushback[--m_pushbackDepth];
+  return ch;
 }
 
 void WebServer::push(int ch)
@@ -829,112 +2055,6 @@ URLPARAM_RESULT WebServer::nextURLparam(char **tail, char *name, int nameLen,
 
 
 
-// Read and parse the first line of the request header.
-// The "command" (GET/HEAD/POST) is translated into a numeric value in type.
-// The URL is stored in request,  up to the length passed in length
-// NOTE 1: length must include one byte for the terminating NUL.
-// NOTE 2: request is NOT checked for NULL,  nor length for a value < 1.
-// Reading stops when the code encounters a space, CR, or LF.  If the HTTP
-// version was supplied by the client,  it will still be waiting in the input
-// stream when we exit.
-//
-// On return, length contains the amount of space left in request.  If it's
-// less than 0,  the URL was longer than the buffer,  and part of it had to
-// be discarded.
-
-void WebServer::getRequest(WebServer::ConnectionType &type,
-                           char *request, int *length)
-{
-  --*length; // save room for NUL
-
-  type = INVALID;
-
-  // store the HTTP method line of the request
-  if (expect("GET "))
-    type = GET;
-  else if (expect("HEAD "))
-    type = HEAD;
-  else if (expect("POST "))
-    type = POST;
-  else if (expect("PUT "))
-    type = PUT;
-  else if (expect("DELETE "))
-    type = DELETE;
-  else if (expect("PATCH "))
-    type = PATCH;
-
-  // if it doesn't start with any of those, we have an unknown method
-  // so just get out of here
-  else
-    return;
-
-  int ch;
-  while ((ch = read()) != -1)
-  {
-    // stop storing at first space or end of line
-    if (ch == ' ' || ch == '\n' || ch == '\r')
-    {
-      break;
-    }
-    if (*length > 0)
-    {
-      *request = ch;
-      ++request;
-    }
-    --*length;
-  }
-  // NUL terminate
-  *request = 0;
-}
-
-void WebServer::processHeaders()
-{
-  // look for three things: the Content-Length header, the Authorization
-  // header, and the double-CRLF that ends the headers.
-
-  // empty the m_authCredentials before every run of this function.
-  // otherwise users who don't send an Authorization header would be treated
-  // like the last user who tried to authenticate (possibly successful)
-  m_authCredentials[0]=0;
-
-  while (1)
-  {
-    if (expect("Content-Length:"))
-    {
-      readInt(m_contentLength);
-#if WEBDUINO_SERIAL_DEBUGGING > 1
-      Serial.print("\n*** got Content-Length of ");
-      Serial.print(m_contentLength);
-      Serial.print(" ***");
-#endif
-      continue;
-    }
-
-    if (expect("Authorization:"))
-    {
-      readHeader(m_authCredentials,51);
-#if WEBDUINO_SERIAL_DEBUGGING > 1
-      Serial.print("\n*** got Authorization: of ");
-      Serial.print(m_authCredentials);
-      Serial.print(" ***");
-#endif
-      continue;
-    }
-
-    if (expect(CRLF CRLF))
-    {
-      m_readingContent = true;
-      return;
-    }
-
-    // no expect checks hit, so just absorb a character and try again
-    if (read() == -1)
-    {
-      return;
-    }
-  }
-}
-
 // void WebServer::outputCheckboxOrRadio(const char *element, const char *name,
 //                                       const char *val, const char *label,
 //                                       bool selected)
@@ -46,14 +46,106 @@
 // of 32 bytes
 #define WEBDUINO_DEFAULT_REQUEST_LENGTH 32
 
-// How long to wait before considering a connection as dead when
-// reading the HTTP request.  Used to avoid DOS attacks.
+// How long a client can take to send the whole HTTP request before
+// its connection is considered dead.  Used to avoid DOS attacks.
 #ifndef WEBDUINO_READ_TIMEOUT_IN_MS
 #define WEBDUINO_READ_TIMEOUT_IN_MS 1000
 #endif
 
+// Clients served concurrently, each one holds a socket of the shield
+#ifndef WEBDUINO_MAX_CLIENTS
+#ifdef __AVR__
+#define WEBDUINO_MAX_CLIENTS 2
+#else
+#define WEBDUINO_MAX_CLIENTS 4
+#endif
+#endif
+
+// Longest URL kept while a client's request is coming in
+#ifndef WEBDUINO_URL_LENGTH
+#ifdef __AVR__
+#define WEBDUINO_URL_LENGTH 100
+#else
+#define WEBDUINO_URL_LENGTH 128
+#endif
+#endif
+
+// Most bytes parsed for each client on a processConnection() call
+#ifndef WEBDUINO_PARSE_BUDGET
+#define WEBDUINO_PARSE_BUDGET 128
+#endif
+
+// Bytes taken from the socket at a time, each read is an SPI
+// transaction on W5x00 chips.  One buffer shared by all the clients:
+// while one has bytes left in it, the others read a byte at a time
+#ifndef WEBDUINO_RX_BUFFER_SIZE
+#ifdef __AVR__
+#define WEBDUINO_RX_BUFFER_SIZE 32
+#else
+#define WEBDUINO_RX_BUFFER_SIZE 128
+#endif
+#endif
+
+// Longest If-None-Match value kept, longer ones never match.  On AVR
+// just one past a quoted tag of 14 chars, as the ones of IonoWeb
+#ifndef WEBDUINO_ETAG_LENGTH
+#ifdef __AVR__
+#define WEBDUINO_ETAG_LENGTH 15
+#else
+#define WEBDUINO_ETAG_LENGTH 20
+#endif
+#endif
+
+// WebSocket upgrades, off on AVR where the key buffer of each client
+// and the handshake code don't fit next to the rest.  httpWebSocket()
+// then always returns false
+#ifndef WEBDUINO_WEBSOCKET
+#ifdef __AVR__
+#define WEBDUINO_WEBSOCKET 0
+#else
+#define WEBDUINO_WEBSOCKET 1
+#endif
+#endif
+
+// Request bodies up to this size are waited for before running the
+// command, so that it can read them without blocking.  With longer
+// ones read() waits for each byte, up to WEBDUINO_READ_TIMEOUT_IN_MS
+#ifndef WEBDUINO_MAX_BODY_WAIT
+#define WEBDUINO_MAX_BODY_WAIT 1024
+#endif
+
+// Longest Content-Length accepted, int is 16 bits on AVR.  Requests
+// with a longer or malformed one are refused and their connection
+// closed, since their body can't be skipped
+#ifndef WEBDUINO_MAX_CONTENT_LENGTH
+#define WEBDUINO_MAX_CONTENT_LENGTH 30000
+#endif
+
+// Idle connections kept open for further requests, and how long.
+// They count against WEBDUINO_MAX_CLIENTS
+#ifndef WEBDUINO_MAX_KEEPALIVE
+#ifdef __AVR__
+#define WEBDUINO_MAX_KEEPALIVE 1
+#else
+#define WEBDUINO_MAX_KEEPALIVE 2
+#endif
+#endif
+
+#ifndef WEBDUINO_KEEPALIVE_TIMEOUT_IN_MS
+#define WEBDUINO_KEEPALIVE_TIMEOUT_IN_MS 5000
+#endif
+
 #ifndef WEBDUINO_COMMANDS_COUNT
+#ifdef __AVR__
 #define WEBDUINO_COMMANDS_COUNT 8
+#else
+#define WEBDUINO_COMMANDS_COUNT 32
+#endif
+#endif
+
+// number of {name} and * values captured by a route
+#ifndef WEBDUINO_ROUTE_PARAMS
+#define WEBDUINO_ROUTE_PARAMS 4
 #endif
 
 #ifndef WEBDUINO_URL_PATH_COMMAND_LENGTH
@@ -76,8 +168,14 @@
 #define WEBDUINO_SERVER_ERROR_MESSAGE "<h1>500 Internal Server Error</h1>"
 #endif // WEBDUINO_SERVER_ERROR_MESSAGE
 
+// Output is sent to the socket in blocks of this size, larger blocks
+// written at once go straight through
 #ifndef WEBDUINO_OUTPUT_BUFFER_SIZE
-#define WEBDUINO_OUTPUT_BUFFER_SIZE 32
+#ifdef __AVR__
+#define WEBDUINO_OUTPUT_BUFFER_SIZE 64
+#else
+#define WEBDUINO_OUTPUT_BUFFER_SIZE 512
+#endif
 #endif // WEBDUINO_OUTPUT_BUFFER_SIZE
 
 #define WEBDUINO_FAVICON_DATA ""
@@ -138,6 +236,12 @@ public:
   typedef void Command(WebServer &server, ConnectionType type,
                        char *url_tail, bool tail_complete);
 
+  // Prototype for the function receiving WebSocket messages.  message is
+  // NUL terminated, messages longer than WEBDUINO_URL_LENGTH - 1 bytes
+  // close the connection.  Replies can be sent with writeWebSocket().
+  typedef void WebSocketCommand(WebServer &server, char *message,
+                                int length, bool binary);
+
   // Prototype for the optional function which consumes the URL path itself.
   // url_path contains pointers to the seperate parts of the URL path where '/'
   //          was used as the delimiter.
@@ -151,15 +255,14 @@ public:
   // start listening for connections
   void begin();
 
-  // check for an incoming connection, and if it exists, process it
-  // by reading its request and calling the appropriate command
-  // handler.  This version is for compatibility with apps written for
-  // version 1.1,  and allocates the URL "tail" buffer internally.
+  // check for incoming connections and read the bytes available of
+  // their requests, calling the appropriate command handler for the
+  // ones complete.  Never waits for the clients.  This version is for
+  // compatibility with apps written for version 1.1,  and allocates
+  // the URL "tail" buffer internally.
   void processConnection();
 
-  // check for an incoming connection, and if it exists, process it
-  // by reading its request and calling the appropriate command
-  // handler.  This version saves the "tail" of the URL in buff.
+  // same as above.  This version saves the "tail" of the URL in buff.
   void processConnection(char *buff, int *bufflen);
 
   // set command that's run when you access the root of the server
@@ -168,14 +271,31 @@ public:
   // set command run for undefined pages
   void setFailureCommand(Command *cmd);
 
-  // add a new command to be run at the URL specified by verb
+  // add a new command to be run at the URL specified by verb, whatever
+  // the method
   void addCommand(const char *verb, Command *cmd);
 
+  // add a command run at path only for the given method, GET also
+  // covering HEAD.  Several commands can share a path with different
+  // methods, the other methods get "405 Method Not Allowed".  A {name}
+  // segment in path matches any single segment of the URL and a final *
+  // the rest of it, e.g. "api/do/{n}" or "files/*".  Their values are
+  // returned by routeParam().  Paths without them are found with a
+  // binary search,  the others are tried in order when none matches.
+  void addRoute(ConnectionType method, const char *path, Command *cmd);
+
+  // value of the index-th {name} or * matched by the current route,
+  // NULL if there is none
+  const char *routeParam(uint8_t index);
+
   // Set command that's run if default command or URL specified commands do
   // not run, uses extra url_path parameter to allow resolving the URL in the
   // function.
   void setUrlPathCommand(UrlPathCommand *cmd);
 
+  // set command run for the messages of the WebSocket connections
+  void setWebSocketCommand(WebSocketCommand *cmd);
+
   // utility function to output CRLF pair
   void printCRLF();
 
@@ -203,7 +323,8 @@ public:
   void checkBox(const char *name, const char *val,
                 const char *label, bool selected);
 
-  // returns next character or -1 if we're at end-of-stream
+  // returns next character or -1 if we're at end-of-stream or
+  // nothing more has been received yet
   int read();
 
   // put a character that's been read back into the input pool
@@ -245,9 +366,20 @@ public:
   // returns true if strings match, false otherwise
   bool checkCredentials(const char authCredentials[45]);
 
+  // value of the If-None-Match header of the current request, quotes
+  // included, empty if there was none
+  const char *ifNoneMatch();
+
+  // true if the If-None-Match header of the current request lists etag
+  // (quotes included) or is "*"
+  bool etagMatches(const char *etag);
+
   // output headers and a message indicating a server error
   void httpFail();
 
+  // output headers and a message indicating "413 Payload Too Large"
+  void httpPayloadTooLarge();
+
   // output headers and a message indicating "401 Unauthorized"
   void httpUnauthorized();
 
@@ -257,17 +389,71 @@ public:
   // output headers indicating "204 No Content" and no further message
   void httpNoContent();
 
+  // output headers indicating "304 Not Modified" for etag, the answer to
+  // a request whose If-None-Match matched.  No body follows
+  void httpNotModified(const char *etag);
+
   // output standard headers indicating "200 Success".  You can change the
   // type of the data you're outputting or also add extra headers like
   // "Refresh: 1".  Extra headers should each be terminated with CRLF.
   void httpSuccess(const char *contentType = "text/html; charset=utf-8",
                    const char *extraHeaders = NULL);
 
+  // same as above for a body of known length.  The connection is then
+  // kept open for further requests if the client asked for it.
+  void httpSuccess(const char *contentType, const char *extraHeaders,
+                   long contentLength);
+
+  // same as above for a body of unknown length, sent with chunked
+  // encoding so that the connection can still be kept open.  What is
+  // written after it goes out a buffer at a time, each as a chunk, up to
+  // endChunked().  HTTP/1.0 clients get the body as it is, followed by
+  // the connection close.
+  void beginChunked(const char *contentType = "text/html; charset=utf-8",
+                    const char *extraHeaders = NULL);
+
+  // sends the last chunk and ends the body, called anyway when the
+  // command returns.
+  void endChunked();
+
   // used with POST to output a redirect to another URL.  This is
   // preferable to outputting HTML from a post because you can then
   // refresh the page without getting a "resubmit form" dialog.
   void httpSeeOther(const char *otherURL);
 
+  // turns the connection of the current request into a Server-Sent
+  // Events stream, left open when the command returns.  Outputs the
+  // headers, the command can then send the first events.  Returns false
+  // if no more streams can be open, one client is kept for requests.
+  bool httpEventStream();
+
+  // write the same data to all the open event streams
+  void writeStreams(const uint8_t *buffer, size_t size);
+
+  // number of event streams open
+  uint8_t streamCount();
+
+  // number of connections open, idle ones kept alive included
+  uint8_t clientCount();
+
+  // accepts the WebSocket upgrade asked by the current request, the
+  // connection is then left open and its messages passed to the
+  // WebSocket command.  Returns false if the request is not a valid
+  // upgrade or no more connections can be open, as for event streams.
+  bool httpWebSocket();
+
+  // send a WebSocket message to the current connection, from a command
+  // that has accepted the upgrade or from the WebSocket command
+  void writeWebSocket(const uint8_t *data, size_t length,
+                      bool binary = false);
+
+  // send a WebSocket message to all the WebSocket connections
+  void broadcastWebSocket(const uint8_t *data, size_t length,
+                          bool binary = false);
+
+  // number of WebSocket connections open
+  uint8_t webSocketCount();
+
   // implementation of write used to implement Print interface
   virtual size_t write(uint8_t);
   virtual size_t write(const uint8_t *buffer, size_t size);
@@ -289,26 +475,111 @@ private:
   unsigned char m_pushbackDepth;
 
   int m_contentLength;
+  bool m_keepAlive;
+  bool m_chunked;
+  bool m_chunkSent;
+  bool m_persist;
+  bool m_stream;
+  bool m_webSocket;
+
+  enum ParserState { PARSE_METHOD, PARSE_URL, PARSE_VERSION,
+                     PARSE_HEADER_NAME, PARSE_HEADER_VALUE, PARSE_BODY,
+                     STREAMING, WEBSOCKET };
+  enum HeaderType { HEADER_OTHER, HEADER_CONTENT_LENGTH,
+                    HEADER_CONNECTION, HEADER_AUTHORIZATION,
+                    HEADER_UPGRADE, HEADER_WEBSOCKET_KEY,
+                    HEADER_IF_NONE_MATCH };
+  // contentLength of a request whose Content-Length can't be used
+  enum { CONTENT_LENGTH_INVALID = -1, CONTENT_LENGTH_TOO_LARGE = -2 };
+
+  // a client and the state of its request parser.  Once upgraded to
+  // WebSocket, token holds the frame header, contentLength and framePos
+  // the payload length and position and url the message received
+  struct Connection
+  {
+    EthernetClient client;
+    unsigned long lastTS;
+    ConnectionType type;
+    uint8_t state;
+    uint8_t header;
+    uint8_t tokenLen;
+    uint8_t opcode;
+    bool held;
+    bool keepAlive;
+    bool http11;
+    bool upgrade;
+    int urlLen;
+    int contentLength;
+    int framePos;
+    char token[18];
+    char url[WEBDUINO_URL_LENGTH];
+#if WEBDUINO_WEBSOCKET
+    char webSocketKey[25];
+#endif
+    char ifNoneMatch[WEBDUINO_ETAG_LENGTH];
+  } m_conns[WEBDUINO_MAX_CLIENTS];
+  Connection *m_conn;
+
+  // what has been read from the socket of m_rxConn and not parsed yet
+  Connection *m_rxConn;
+  uint8_t m_rxPos;
+  uint8_t m_rxLen;
+  uint8_t m_rx[WEBDUINO_RX_BUFFER_SIZE];
+
+  // the Authorization header of m_authConn, taken from when it starts
+  // until the request is served.  Another client reaching its own
+  // waits for it, the header is rare and the requests short
+  Connection *m_authConn;
   char m_authCredentials[51];
-  bool m_readingContent;
+  WebSocketCommand *m_webSocketCmd;
 
   Command *m_failureCmd;
   Command *m_defaultCmd;
+  // the exact paths first, sorted, then the patterns
   struct CommandMap
   {
     const char *verb;
     Command *cmd;
+    uint8_t methods;
   } m_commands[WEBDUINO_COMMANDS_COUNT];
   unsigned char m_cmdCount;
+  unsigned char m_exactCount;
+  char *m_routeParams[WEBDUINO_ROUTE_PARAMS];
   UrlPathCommand *m_urlPathCmd;
 
   uint8_t m_buffer[WEBDUINO_OUTPUT_BUFFER_SIZE];
-  uint8_t m_bufFill;
+  uint16_t m_bufFill;
 
-  void getRequest(WebServer::ConnectionType &type, char *request, int *length);
   bool dispatchCommand(ConnectionType requestType, char *verb,
                        bool tail_complete);
-  void processHeaders();
+  void insertCommand(const char *verb, Command *cmd, uint8_t methods);
+  int findCommand(ConnectionType requestType, char *verb, uint16_t verb_len,
+                  uint8_t *allowed);
+  static int compareVerb(const char *verb, uint16_t verb_len,
+                         const char *route);
+  bool matchRoute(const char *route, char *verb, uint16_t verb_len,
+                  bool capture);
+  void httpMethodNotAllowed(uint8_t methods);
+  void printConnectionHeaders(long contentLength);
+  void printKeepAlive();
+  void writeChunk(const uint8_t *data, size_t size);
+  void acceptConnection();
+  Connection *findConnection(EthernetClient &client);
+  void startRequest(Connection &conn);
+  bool parseRequest(Connection &conn);
+  int receive(Connection &conn);
+  int received(Connection &conn);
+  void parseChar(Connection &conn, char ch);
+  void endHeader(Connection &conn);
+  void serveRequest(Connection &conn, char *buff, int size, int *bufflen);
+  void closeConnection(Connection &conn);
+  void releaseBuffers(Connection &conn);
+  uint8_t countConnections(uint8_t state);
+  void parseWebSocket(Connection &conn);
+  bool startFrame(Connection &conn);
+  bool endFrame(Connection &conn);
+  void writeFrame(uint8_t opcode, const uint8_t *data, size_t length);
+  void closeWebSocket(Connection &conn, uint16_t status);
   void outputCheckboxOrRadio(const char *element, const char *name,
                              const char *val, const char *label,
                              bool selected);